@@ -23,12 +23,22 @@ SOFTWARE.
 */
 
 #include "monoque.hh"
+#include "monodeque.hh"
+#include "monoque_simd.hh"
+#include "monoque_hugepage.hh"
+#include "monoque_sort.hh"
+#include "monoque_heap.hh"
+#include "monoque_queue.hh"
+#include "bit_monoque.hh"
+#include "monoque_soa.hh"
+#include "compact_monoque.hh"
 #include <assert.h>
 #include <atomic>
 #include <chrono>
 #include <deque>
 #include <fstream>
 #include <iomanip>
+#include <numeric>
 #include <iostream>
 #include <queue>
 #include <random>
@@ -117,6 +127,369 @@ int main() {
   cout << "monoque<size_t> best average push_back time: " << fast_push / round_count << " nanoseconds" << endl;
   cout << "monoque<size_t> best average random access time: " << fast_access / round_secondary << " nanoseconds" << endl;
 
+  fast_push = std::numeric_limits<double>::max();
+  fast_access = std::numeric_limits<double>::max();
+  for (size_t r = 0; r < runs; ++r) {
+    monoque<size_t, hugepage_allocator<size_t>> m;
+    start_time = system_clock::now();
+
+    for (size_t i = 0; i < round_count; i++) {
+      m.push_back(i);
+    }
+    end_time = system_clock::now();
+    fast_push = std::min(fast_push, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+
+    start_time = system_clock::now();
+    for (size_t i = 0; i < round_secondary; i++) {
+      vol += m[rds[i % round_count]];
+    }
+    end_time = system_clock::now();
+    fast_access = std::min(fast_access, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+  }
+  cout << "monoque<size_t, hugepage_allocator> best average push_back time: " << fast_push / round_count << " nanoseconds" << endl;
+  cout << "monoque<size_t, hugepage_allocator> best average random access time: " << fast_access / round_secondary << " nanoseconds" << endl;
+
+  // Worst single push_back, with and without ahead-of-time block preallocation.
+  fast_push = std::numeric_limits<double>::max();
+  double fast_preallocated_push = std::numeric_limits<double>::max();
+  for (size_t r = 0; r < runs; ++r) {
+    for (int mode = 0; mode < 2; mode++) {
+      monoque<size_t> m;
+      if (mode == 1)
+        m.set_preallocation(0.5f);
+      double worst = 0;
+      for (size_t i = 0; i < round_count; i++) {
+        start_time = system_clock::now();
+        m.push_back(i);
+        end_time = system_clock::now();
+        worst = std::max(worst, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+      }
+      vol += m.back();
+      double &best = mode == 0 ? fast_push : fast_preallocated_push;
+      best = std::min(best, worst);
+    }
+  }
+  cout << "monoque<size_t> best worst-case push_back time: " << fast_push << " nanoseconds" << endl;
+  cout << "monoque<size_t> with set_preallocation(0.5) best worst-case push_back time: " << fast_preallocated_push << " nanoseconds" << endl;
+
+  fast_push = std::numeric_limits<double>::max();
+  fast_access = std::numeric_limits<double>::max();
+  double fast_sort = std::numeric_limits<double>::max();
+  for (size_t r = 0; r < runs; ++r) {
+    std::vector<size_t> v(rds.begin(), rds.begin() + round_count);
+    monoque<size_t> m;
+    m.append(v.begin(), v.end());
+    monoque<size_t> m2 = m;
+
+    start_time = system_clock::now();
+    std::sort(v.begin(), v.end());
+    end_time = system_clock::now();
+    fast_push = std::min(fast_push, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+
+    start_time = system_clock::now();
+    rpnx::sort(m, std::less<size_t>());
+    end_time = system_clock::now();
+    fast_access = std::min(fast_access, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+
+    start_time = system_clock::now();
+    rpnx::sort(m2);
+    end_time = system_clock::now();
+    fast_sort = std::min(fast_sort, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+    vol += v[round_count / 2] + m[round_count / 2] + m2[round_count / 2];
+  }
+  cout << "vector<size_t> std::sort best average time per element: " << fast_push / round_count << " nanoseconds" << endl;
+  cout << "monoque<size_t> rpnx::sort (merge) best average time per element: " << fast_access / round_count << " nanoseconds" << endl;
+  cout << "monoque<size_t> rpnx::sort (radix) best average time per element: " << fast_sort / round_count << " nanoseconds" << endl;
+
+  fast_push = std::numeric_limits<double>::max();
+  fast_access = std::numeric_limits<double>::max();
+  for (size_t r = 0; r < runs; ++r) {
+    std::vector<size_t> v(rds.begin(), rds.begin() + round_count);
+    monoque<size_t> m;
+    m.append(v.begin(), v.end());
+
+    start_time = system_clock::now();
+    v.erase(std::remove_if(v.begin(), v.end(), [](size_t x) { return x % 8 == 0; }), v.end());
+    end_time = system_clock::now();
+    fast_push = std::min(fast_push, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+
+    start_time = system_clock::now();
+    m.erase_if([](size_t x) { return x % 8 == 0; });
+    end_time = system_clock::now();
+    fast_access = std::min(fast_access, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+    vol += v.size() + m.size();
+  }
+  cout << "vector<size_t> erase(remove_if) best average time per element: " << fast_push / round_count << " nanoseconds" << endl;
+  cout << "monoque<size_t> erase_if best average time per element: " << fast_access / round_count << " nanoseconds" << endl;
+
+  // FIFO traffic: fill to a backlog of 4096, then one push and one pop per step.
+  fast_push = std::numeric_limits<double>::max();
+  fast_access = std::numeric_limits<double>::max();
+  for (size_t r = 0; r < runs; ++r) {
+    queue<size_t, std::deque<size_t>> d;
+    monoque_queue<size_t> q;
+
+    start_time = system_clock::now();
+    for (size_t i = 0; i < round_count; i++) {
+      d.push(i);
+      if (d.size() > 4096)
+        d.pop();
+    }
+    vol += d.front();
+    end_time = system_clock::now();
+    fast_push = std::min(fast_push, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+
+    start_time = system_clock::now();
+    for (size_t i = 0; i < round_count; i++) {
+      q.push(i);
+      if (q.size() > 4096)
+        q.pop();
+    }
+    vol += q.front();
+    end_time = system_clock::now();
+    fast_access = std::min(fast_access, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+  }
+  cout << "queue<size_t, deque> best average push()+pop() time: " << fast_push / round_count << " nanoseconds" << endl;
+  cout << "monoque_queue<size_t> best average push()+pop() time: " << fast_access / round_count << " nanoseconds" << endl;
+
+  fast_push = std::numeric_limits<double>::max();
+  fast_access = std::numeric_limits<double>::max();
+  for (size_t r = 0; r < runs; ++r) {
+    monoque<uint8_t> bytes;
+    bit_monoque<> bits;
+    for (size_t i = 0; i < round_count; i++) {
+      bytes.push_back(rds[i] % 3 == 0);
+      bits.push_back(rds[i] % 3 == 0);
+    }
+
+    start_time = system_clock::now();
+    size_t c = 0;
+    bytes.for_each_segment([&](uint8_t const *p, size_t n) {
+      for (size_t i = 0; i < n; i++)
+        c += p[i];
+    });
+    vol += c;
+    end_time = system_clock::now();
+    fast_push = std::min(fast_push, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+
+    start_time = system_clock::now();
+    vol += bits.count();
+    end_time = system_clock::now();
+    fast_access = std::min(fast_access, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+  }
+  cout << "monoque<uint8_t> best average count time per flag: " << fast_push / round_count << " nanoseconds" << endl;
+  cout << "bit_monoque best average count() time per flag: " << fast_access / round_count << " nanoseconds" << endl;
+
+  {
+    // Eight field records, of which the scan reads one.
+    struct record {
+      uint64_t f[8];
+    };
+    size_t rows = round_count / 32;
+    fast_push = std::numeric_limits<double>::max();
+    fast_access = std::numeric_limits<double>::max();
+    for (size_t r = 0; r < runs; ++r) {
+      monoque<record> aos;
+      monoque_soa<uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t> soa;
+      for (size_t i = 0; i < rows; i++) {
+        record rec = {{rds[i], i, i, i, i, i, i, i}};
+        aos.push_back(rec);
+        soa.emplace_back(rds[i], i, i, i, i, i, i, i);
+      }
+
+      start_time = system_clock::now();
+      uint64_t t = 0;
+      aos.for_each_segment([&](record const *p, size_t n) {
+        for (size_t i = 0; i < n; i++)
+          t += p[i].f[0];
+      });
+      vol += t;
+      end_time = system_clock::now();
+      fast_push = std::min(fast_push, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+
+      start_time = system_clock::now();
+      t = 0;
+      soa.column<0>().for_each_segment([&](uint64_t const *p, size_t n) {
+        for (size_t i = 0; i < n; i++)
+          t += p[i];
+      });
+      vol += t;
+      end_time = system_clock::now();
+      fast_access = std::min(fast_access, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+    }
+    cout << "monoque<record> best average one field scan time: " << fast_push / rows << " nanoseconds" << endl;
+    cout << "monoque_soa best average one column scan time: " << fast_access / rows << " nanoseconds" << endl;
+  }
+
+  fast_push = std::numeric_limits<double>::max();
+  fast_access = std::numeric_limits<double>::max();
+  fast_sort = std::numeric_limits<double>::max();
+  for (size_t r = 0; r < runs; ++r) {
+    {
+      monoque<size_t> m;
+      start_time = system_clock::now();
+      for (size_t i = 0; i < round_count; i++)
+        m.push_back(size_t());
+      end_time = system_clock::now();
+      fast_push = std::min(fast_push, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+    }
+    {
+      monoque<size_t> m;
+      start_time = system_clock::now();
+      m.resize(round_count);
+      end_time = system_clock::now();
+      fast_access = std::min(fast_access, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+    }
+    {
+      monoque<size_t> m;
+      start_time = system_clock::now();
+      m.resize_for_overwrite(round_count);
+      end_time = system_clock::now();
+      fast_sort = std::min(fast_sort, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+    }
+  }
+  cout << "monoque<size_t> best average push_back(size_t()) sizing time: " << fast_push / round_count << " nanoseconds" << endl;
+  cout << "monoque<size_t> best average resize() time per element: " << fast_access / round_count << " nanoseconds" << endl;
+  cout << "monoque<size_t> best average resize_for_overwrite() time per element: " << fast_sort / round_count << " nanoseconds" << endl;
+
+  {
+    vector<size_t> v(rds.begin(), rds.begin() + round_count);
+    monoque<size_t> m;
+    m.append(rds.begin(), rds.begin() + round_count);
+    double fast_vector = std::numeric_limits<double>::max();
+    double fast_find = std::numeric_limits<double>::max();
+    double fast_segmented = std::numeric_limits<double>::max();
+    fast_access = std::numeric_limits<double>::max();
+    for (size_t r = 0; r < runs; ++r) {
+      size_t t = 0;
+      start_time = system_clock::now();
+      for (size_t x : v)
+        t += x;
+      end_time = system_clock::now();
+      fast_vector = std::min(fast_vector, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+
+      start_time = system_clock::now();
+      for (size_t x : m)
+        t += x;
+      end_time = system_clock::now();
+      fast_access = std::min(fast_access, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+
+      start_time = system_clock::now();
+      t += std::find(m.cbegin(), m.cend(), round_count) - m.cbegin();
+      end_time = system_clock::now();
+      fast_find = std::min(fast_find, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+
+      start_time = system_clock::now();
+      t += segmented::find(m.cbegin(), m.cend(), round_count) - m.cbegin();
+      end_time = system_clock::now();
+      fast_segmented = std::min(fast_segmented, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+      vol += t;
+    }
+    cout << "vector<size_t> best average range-for time: " << fast_vector / round_count << " nanoseconds" << endl;
+    cout << "monoque<size_t> best average range-for time: " << fast_access / round_count << " nanoseconds" << endl;
+    cout << "monoque<size_t> best average std::find time per element: " << fast_find / round_count << " nanoseconds" << endl;
+    cout << "monoque<size_t> best average segmented::find time per element: " << fast_segmented / round_count << " nanoseconds" << endl;
+  }
+
+  {
+    // Just past a power of two, where the doubling layout wastes the most.
+    size_t n = round_count / 2 + round_count / 64;
+    fast_push = std::numeric_limits<double>::max();
+    fast_access = std::numeric_limits<double>::max();
+    double fast_compact_push = std::numeric_limits<double>::max();
+    double fast_compact_access = std::numeric_limits<double>::max();
+    size_t slack = 0, compact_slack = 0;
+    for (size_t r = 0; r < runs; ++r) {
+      {
+        monoque<size_t> m;
+        start_time = system_clock::now();
+        for (size_t i = 0; i < n; i++)
+          m.push_back(i);
+        end_time = system_clock::now();
+        fast_push = std::min(fast_push, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+        slack = m.capacity() - m.size();
+
+        start_time = system_clock::now();
+        for (size_t i = 0; i < n; i++)
+          vol += m[rds[i] % n];
+        end_time = system_clock::now();
+        fast_access = std::min(fast_access, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+      }
+      {
+        compact_monoque<size_t> m;
+        start_time = system_clock::now();
+        for (size_t i = 0; i < n; i++)
+          m.push_back(i);
+        end_time = system_clock::now();
+        fast_compact_push = std::min(fast_compact_push, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+        compact_slack = m.capacity() - m.size() + m.block_count();
+
+        start_time = system_clock::now();
+        for (size_t i = 0; i < n; i++)
+          vol += m[rds[i] % n];
+        end_time = system_clock::now();
+        fast_compact_access = std::min(fast_compact_access, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+      }
+    }
+    cout << "monoque<size_t> unused bytes at " << n << " elements: " << slack * sizeof(size_t) << " (" << 100.0 * slack / n << "% of size)" << endl;
+    cout << "compact_monoque<size_t> unused and index bytes at " << n << " elements: " << compact_slack * sizeof(size_t) << " ("
+         << 100.0 * compact_slack / n << "% of size)" << endl;
+    cout << "monoque<size_t> best average push_back() time: " << fast_push / n << " nanoseconds" << endl;
+    cout << "compact_monoque<size_t> best average push_back() time: " << fast_compact_push / n << " nanoseconds" << endl;
+    cout << "monoque<size_t> best average random operator[] time: " << fast_access / n << " nanoseconds" << endl;
+    cout << "compact_monoque<size_t> best average random operator[] time: " << fast_compact_access / n << " nanoseconds" << endl;
+  }
+
+  fast_push = std::numeric_limits<double>::max();
+  fast_access = std::numeric_limits<double>::max();
+  for (size_t r = 0; r < runs; ++r) {
+    monoque<size_t> m;
+    for (size_t i = 0; i < round_count; i++) {
+      m.push_back(i);
+    }
+
+    start_time = system_clock::now();
+    size_t t = 0;
+    for (auto const &x : m)
+      t += x;
+    vol += t;
+    end_time = system_clock::now();
+    fast_push = std::min(fast_push, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+
+    start_time = system_clock::now();
+    t = 0;
+    m.for_each_segment([&](size_t const *p, size_t n) {
+      for (size_t i = 0; i < n; i++)
+        t += p[i];
+    });
+    vol += t;
+    end_time = system_clock::now();
+    fast_access = std::min(fast_access, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+  }
+  cout << "monoque<size_t> best average iterator scan time: " << fast_push / round_count << " nanoseconds" << endl;
+  cout << "monoque<size_t> best average for_each_segment scan time: " << fast_access / round_count << " nanoseconds" << endl;
+
+  fast_push = std::numeric_limits<double>::max();
+  fast_access = std::numeric_limits<double>::max();
+  for (size_t r = 0; r < runs; ++r) {
+    monoque<size_t> m;
+    for (size_t i = 0; i < round_count; i++) {
+      m.push_back(i);
+    }
+
+    start_time = system_clock::now();
+    vol += std::accumulate(m.begin(), m.end(), size_t(0));
+    end_time = system_clock::now();
+    fast_push = std::min(fast_push, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+
+    start_time = system_clock::now();
+    vol += rpnx::simd::sum(m);
+    end_time = system_clock::now();
+    fast_access = std::min(fast_access, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+  }
+  cout << "monoque<size_t> best average std::accumulate time: " << fast_push / round_count << " nanoseconds" << endl;
+  cout << "monoque<size_t> best average simd::sum time: " << fast_access / round_count << " nanoseconds" << endl;
+
   fast_push = std::numeric_limits<double>::max();
   fast_access = std::numeric_limits<double>::max();
   for (size_t r = 0; r < runs; ++r) {
@@ -143,6 +516,78 @@ int main() {
   cout << "deque<size_t> best average push_back time: " << fast_push / round_count << " nanoseconds" << endl;
   cout << "deque<size_t> best average random access time: " << fast_access / round_secondary << " nanoseconds" << endl;
 
+  double fast_pop = std::numeric_limits<double>::max();
+  fast_push = std::numeric_limits<double>::max();
+  fast_access = std::numeric_limits<double>::max();
+  for (size_t r = 0; r < runs; ++r) {
+    deque<size_t> m;
+
+    start_time = system_clock::now();
+    for (size_t i = 0; i < round_count; i++) {
+      if (i & 1)
+        m.push_back(i);
+      else
+        m.push_front(i);
+    }
+    end_time = system_clock::now();
+    fast_push = std::min(fast_push, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+
+    start_time = system_clock::now();
+    for (size_t i = 0; i < round_secondary; i++) {
+      vol += m[rds[i % round_count]];
+    }
+    end_time = system_clock::now();
+    fast_access = std::min(fast_access, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+
+    start_time = system_clock::now();
+    for (size_t i = 0; i < round_count; i++) {
+      vol += m.front();
+      m.pop_front();
+    }
+    end_time = system_clock::now();
+    fast_pop = std::min(fast_pop, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+  }
+
+  cout << "deque<size_t> best average push_front/push_back time: " << fast_push / round_count << " nanoseconds" << endl;
+  cout << "deque<size_t> best average random access time: " << fast_access / round_secondary << " nanoseconds" << endl;
+  cout << "deque<size_t> best average pop_front time: " << fast_pop / round_count << " nanoseconds" << endl;
+
+  fast_pop = std::numeric_limits<double>::max();
+  fast_push = std::numeric_limits<double>::max();
+  fast_access = std::numeric_limits<double>::max();
+  for (size_t r = 0; r < runs; ++r) {
+    monodeque<size_t> m;
+
+    start_time = system_clock::now();
+    for (size_t i = 0; i < round_count; i++) {
+      if (i & 1)
+        m.push_back(i);
+      else
+        m.push_front(i);
+    }
+    end_time = system_clock::now();
+    fast_push = std::min(fast_push, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+
+    start_time = system_clock::now();
+    for (size_t i = 0; i < round_secondary; i++) {
+      vol += m[rds[i % round_count]];
+    }
+    end_time = system_clock::now();
+    fast_access = std::min(fast_access, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+
+    start_time = system_clock::now();
+    for (size_t i = 0; i < round_count; i++) {
+      vol += m.front();
+      m.pop_front();
+    }
+    end_time = system_clock::now();
+    fast_pop = std::min(fast_pop, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+  }
+
+  cout << "monodeque<size_t> best average push_front/push_back time: " << fast_push / round_count << " nanoseconds" << endl;
+  cout << "monodeque<size_t> best average random access time: " << fast_access / round_secondary << " nanoseconds" << endl;
+  cout << "monodeque<size_t> best average pop_front time: " << fast_pop / round_count << " nanoseconds" << endl;
+
  fast_push = std::numeric_limits<double>::max();
   fast_access = std::numeric_limits<double>::max();
   for (size_t r = 0; r < runs; ++r) {
@@ -231,6 +676,41 @@ int main() {
   cout << "priority_queue<size_t, monoque> best average push() time: " << fast_push / round_count << " nanoseconds" << endl;
   cout << "priority_queue<size_t, monoque> best average top()+pop()+push() time: " << fast_access / round_count /round_mult << " nanoseconds" << endl;
 
+  fast_push = std::numeric_limits<double>::max();
+  fast_access = std::numeric_limits<double>::max();
+  double fast_replace = std::numeric_limits<double>::max();
+  for (size_t r = 0; r < runs; ++r) {
+    rpnx::monoque_heap<size_t> m;
+
+    start_time = system_clock::now();
+    for (size_t i = 0; i < round_count; i++) {
+      m.push(rds[i % round_count]);
+    }
+    end_time = system_clock::now();
+    fast_push = std::min(fast_push, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+
+    start_time = system_clock::now();
+    for (size_t i = 0; i < round_count*round_mult; i++) {
+      vol += m.top();
+      m.pop();
+      m.push(rds[(i+17) % round_count]);
+    }
+    end_time = system_clock::now();
+    fast_access = std::min(fast_access, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+
+    start_time = system_clock::now();
+    for (size_t i = 0; i < round_count*round_mult; i++) {
+      vol += m.top();
+      m.pop_push(rds[(i+17) % round_count]);
+    }
+    end_time = system_clock::now();
+    fast_replace = std::min(fast_replace, (double)(duration_cast<nanoseconds>(end_time - start_time).count()));
+  }
+
+  cout << "monoque_heap<size_t> best average push() time: " << fast_push / round_count << " nanoseconds" << endl;
+  cout << "monoque_heap<size_t> best average top()+pop()+push() time: " << fast_access / round_count /round_mult << " nanoseconds" << endl;
+  cout << "monoque_heap<size_t> best average top()+pop_push() time: " << fast_replace / round_count /round_mult << " nanoseconds" << endl;
+
   fast_push = std::numeric_limits<double>::max();
   fast_access = std::numeric_limits<double>::max();
   for (size_t r = 0; r < runs; ++r) {
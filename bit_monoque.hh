@@ -0,0 +1,244 @@
+/*
+Bit Monoque
+
+Copyright (c) 2017, 2018 Ryan P. Nicholl <exaeta@protonmail.com> http://rpnx.net/
+ -- Please let me know if you find this structure useful, thanks!
+
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef RPNX_BIT_MONOQUE_HH
+#define RPNX_BIT_MONOQUE_HH
+
+#include "monoque.hh"
+
+/*
+  A packed sequence of bits: 64 per word, words kept in a monoque<uint64_t>,
+  so push_back keeps monoque's worst-case O(1) growth and test/set are one
+  block lookup. Bits past size() in the last word are always zero.
+
+  count(), rank(i) (set bits in [0, i)) and find_next_set(i) scan words with
+  popcnt / tzcnt, using the popcnt instruction when the CPU has it even if
+  the build does not target it.
+
+  With RankDirectory, rank(i) and count() also keep a cumulative count per
+  512 bit superblock, one extra bit in eight. A write only lowers the valid
+  prefix, so set() stays O(1). The non-const rank() and count() fill entries
+  lazily up to the superblock they need, so repeated queries cost O(1)
+  amortized. The const overloads never write: they use the valid prefix and
+  popcount the rest, so any number of threads may call them at once. Call
+  build_rank() after the last write to make those O(1) as well.
+ */
+
+namespace rpnx {
+
+inline size_t popcount_words_generic_pv(uint64_t const *p, size_t n) {
+  size_t r = 0;
+  for (size_t i = 0; i != n; i++)
+    r += size_t(__builtin_popcountll(p[i]));
+  return r;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+__attribute__((target("popcnt"))) inline size_t popcount_words_popcnt_pv(uint64_t const *p, size_t n) {
+  size_t r = 0;
+  for (size_t i = 0; i != n; i++)
+    r += size_t(__builtin_popcountll(p[i]));
+  return r;
+}
+
+inline size_t popcount_words_pv(uint64_t const *p, size_t n) {
+  static bool const hw = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("popcnt");
+  }();
+  return hw ? popcount_words_popcnt_pv(p, n) : popcount_words_generic_pv(p, n);
+}
+#else
+inline size_t popcount_words_pv(uint64_t const *p, size_t n) { return popcount_words_generic_pv(p, n); }
+#endif
+
+template <typename Allocator = std::allocator<uint64_t>, bool RankDirectory = true> class bit_monoque {
+public:
+  using word_container = monoque<uint64_t, Allocator>;
+  using size_type = size_t;
+  static constexpr size_t superblock_words = 8;
+
+private:
+  word_container words_pv;
+  size_t size_pv;
+  // ranks_pv[j] is the number of set bits in words [0, superblock_words * j); entries below ranked_pv are current.
+  word_container ranks_pv;
+  size_t ranked_pv;
+
+  void touched_pv(size_t word) {
+    if (RankDirectory)
+      ranked_pv = std::min(ranked_pv, word / superblock_words + 1);
+  }
+
+  size_t popcount_range_pv(size_t first, size_t last) const {
+    size_t r = 0;
+    words_pv.for_each_segment(first, last, [&](uint64_t const *p, size_t n) { r += popcount_words_pv(p, n); });
+    return r;
+  }
+
+  // Number of set bits in words [0, w), from the valid prefix of the directory; never writes.
+  size_t rank_words_pv(size_t w) const {
+    if (!RankDirectory || ranked_pv == 0)
+      return popcount_range_pv(0, w);
+    size_t s = std::min(w / superblock_words, ranked_pv - 1);
+    return size_t(ranks_pv[s]) + popcount_range_pv(s * superblock_words, w);
+  }
+
+  // Makes directory entries [0, s] current.
+  void extend_rank_pv(size_t s) {
+    if (!RankDirectory)
+      return;
+    if (ranked_pv == 0) {
+      if (ranks_pv.empty())
+        ranks_pv.push_back(0);
+      ranked_pv = 1;
+    }
+    for (; ranked_pv <= s; ranked_pv++) {
+      uint64_t v = ranks_pv[ranked_pv - 1] + popcount_range_pv((ranked_pv - 1) * superblock_words, ranked_pv * superblock_words);
+      if (ranks_pv.size() == ranked_pv)
+        ranks_pv.push_back(v);
+      else
+        ranks_pv[ranked_pv] = v;
+    }
+  }
+
+public:
+  bit_monoque() : size_pv(0), ranked_pv(0) {}
+  explicit bit_monoque(Allocator const &alloc) : words_pv(alloc), size_pv(0), ranks_pv(alloc), ranked_pv(0) {}
+
+  bit_monoque(size_t n, bool value, Allocator const &alloc = Allocator()) : bit_monoque(alloc) {
+    words_pv.append_n((n + 63) / 64, value ? ~uint64_t(0) : 0);
+    size_pv = n;
+    if (value && n % 64 != 0)
+      words_pv.back() &= (uint64_t(1) << (n % 64)) - 1;
+  }
+
+  size_type size() const { return size_pv; }
+  bool empty() const { return size_pv == 0; }
+
+  bool test(size_t i) const { return (words_pv[i / 64] >> (i % 64)) & 1; }
+  bool operator[](size_t i) const { return test(i); }
+
+  void set(size_t i, bool value = true) {
+    uint64_t &w = words_pv[i / 64];
+    uint64_t bit = uint64_t(1) << (i % 64);
+    w = value ? (w | bit) : (w & ~bit);
+    touched_pv(i / 64);
+  }
+
+  void reset(size_t i) { set(i, false); }
+
+  void flip(size_t i) {
+    words_pv[i / 64] ^= uint64_t(1) << (i % 64);
+    touched_pv(i / 64);
+  }
+
+  void push_back(bool value) {
+    if (size_pv % 64 == 0)
+      words_pv.push_back(0);
+    if (value) {
+      words_pv.back() |= uint64_t(1) << (size_pv % 64);
+      touched_pv(size_pv / 64);
+    }
+    size_pv++;
+  }
+
+  void pop_back() {
+    assert(size_pv != 0);
+    size_pv--;
+    reset(size_pv);
+    if (size_pv % 64 == 0)
+      words_pv.pop_back();
+  }
+
+  void clear() {
+    words_pv.clear();
+    size_pv = 0;
+    ranked_pv = 0;
+  }
+
+  // Brings the whole rank directory up to date, so the const rank() and count() are O(1) until the next write.
+  void build_rank() { extend_rank_pv(words_pv.size() / superblock_words); }
+
+  // Number of set bits.
+  size_type count() const { return rank_words_pv(words_pv.size()); }
+  size_type count() {
+    build_rank();
+    return static_cast<bit_monoque const &>(*this).count();
+  }
+
+  // Number of set bits in [0, i), for i <= size().
+  size_type rank(size_t i) const {
+    size_t r = rank_words_pv(i / 64);
+    if (i % 64 != 0)
+      r += size_t(__builtin_popcountll(words_pv[i / 64] & ((uint64_t(1) << (i % 64)) - 1)));
+    return r;
+  }
+  size_type rank(size_t i) {
+    extend_rank_pv(i / 64 / superblock_words);
+    return static_cast<bit_monoque const &>(*this).rank(i);
+  }
+
+  // Position of the first set bit at or after i, or size() if there is none.
+  size_type find_next_set(size_t i) const {
+    if (i >= size_pv)
+      return size_pv;
+    uint64_t w = words_pv[i / 64] & (~uint64_t(0) << (i % 64));
+    if (w != 0)
+      return (i / 64) * 64 + size_t(__builtin_ctzll(w));
+
+    size_t found = size_pv;
+    size_t base = i / 64 + 1;
+    // for_each_segment cannot stop early; the blocks after a hit are skipped by the first test.
+    words_pv.for_each_segment(base, words_pv.size(), [&](uint64_t const *p, size_t n) {
+      if (found != size_pv)
+        return;
+      for (size_t j = 0; j != n; j++) {
+        if (p[j] != 0) {
+          found = (base + j) * 64 + size_t(__builtin_ctzll(p[j]));
+          return;
+        }
+      }
+      base += n;
+    });
+    return found;
+  }
+
+  // The packed words, 64 bits each, bit i of the sequence being bit i % 64 of word i / 64.
+  word_container const &words() const { return words_pv; }
+
+  void swap(bit_monoque &other) {
+    words_pv.swap(other.words_pv);
+    ranks_pv.swap(other.ranks_pv);
+    std::swap(size_pv, other.size_pv);
+    std::swap(ranked_pv, other.ranked_pv);
+  }
+
+  friend void swap(bit_monoque &a, bit_monoque &b) { a.swap(b); }
+};
+} // namespace rpnx
+
+#endif
@@ -0,0 +1,328 @@
+/*
+Compact Monoque
+
+Copyright (c) 2017, 2018 Ryan P. Nicholl <exaeta@protonmail.com> http://rpnx.net/
+ -- Please let me know if you find this structure useful, thanks!
+
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef RPNX_COMPACT_MONOQUE_HH
+#define RPNX_COMPACT_MONOQUE_HH
+
+#include "monoque.hh"
+
+/*
+  A monoque variant that trades a little indexing work for O(sqrt n) unused
+  space, after Brodnik, Carlsson, Demaine, Munro and Sedgewick, "Resizable
+  Arrays in Optimal Time and Space".
+
+  monoque's blocks double, so just past a power of two nearly half of the
+  last block is allocated but unused. Here the elements are grouped into
+  superblocks: superblock s holds 2^floor(s/2) data blocks of 2^ceil(s/2)
+  elements each, so blocks only grow as sqrt(n) and at most one partly
+  filled block plus one empty spare block are ever allocated past size().
+  The pointers to the data blocks are kept in a monoque, which is itself
+  O(sqrt n) long.
+
+  push_back stays O(1) worst case (one block allocation and one push_back on
+  the index), and operator[] stays O(1): one log2, a few shifts and two
+  dependent loads instead of one.
+ */
+
+namespace rpnx {
+struct compact_monoque_layout {
+  // Data blocks in superblocks 0 .. k - 1.
+  static inline size_t blocks_before(size_t k) { return ((2 + (k & 1)) << (k / 2)) - 2; }
+
+  // Data block and offset of element i.
+  static inline std::tuple<size_t, size_t> index(size_t i) {
+    size_t r = i + 1;
+    size_t k = monoque_layout::log2(r);
+    size_t h = (k + 1) / 2;
+    size_t w = r - (size_t(1) << k);
+    return std::tuple<size_t, size_t>{blocks_before(k) + (w >> h), w & ((size_t(1) << h) - 1)};
+  }
+
+  // Capacity of the data block holding element i.
+  static inline size_t sizeat(size_t i) { return size_t(1) << ((monoque_layout::log2(i + 1) + 1) / 2); }
+};
+
+template <typename T, typename Allocator = std::allocator<T>> class compact_monoque : private Allocator {
+public:
+  using value_type = T;
+  using allocator_type = Allocator;
+  using size_type = size_t;
+  using difference_type = ssize_t;
+  using reference = T &;
+  using const_reference = T const &;
+  using layout = compact_monoque_layout;
+
+private:
+  using traits_pv = std::allocator_traits<Allocator>;
+  using index_type_pv = monoque<T *, typename traits_pv::template rebind_alloc<T *>>;
+
+  index_type_pv blocks_pv;
+  size_t size_pv;
+  // Elements held by the allocated data blocks.
+  size_t capacity_pv;
+
+  T *locate_pv(size_t i) const {
+    using namespace std;
+    size_t d, o;
+    tie(d, o) = layout::index(i);
+    return blocks_pv[d] + o;
+  }
+
+  void open_block_pv() {
+    size_t n = layout::sizeat(capacity_pv);
+    T *p = traits_pv::allocate(*this, n);
+    try {
+      blocks_pv.push_back(p);
+    } catch (...) {
+      traits_pv::deallocate(*this, p, n);
+      throw;
+    }
+    capacity_pv += n;
+  }
+
+  void close_block_pv() {
+    size_t n = layout::sizeat(capacity_pv - 1);
+    traits_pv::deallocate(*this, blocks_pv.back(), n);
+    blocks_pv.pop_back();
+    capacity_pv -= n;
+  }
+
+  template <typename Self, typename F> static void for_each_segment_pv(Self &self, size_t first, size_t last, F &f) {
+    using namespace std;
+    while (first < last) {
+      size_t d, o;
+      tie(d, o) = layout::index(first);
+      size_t n = std::min(layout::sizeat(first) - o, last - first);
+      f(self.blocks_pv[d] + o, n);
+      first += n;
+    }
+  }
+
+  template <typename M, typename U> class basic_iterator {
+    friend class compact_monoque<T, Allocator>;
+    template <typename, typename> friend class basic_iterator;
+
+    M *m;
+    size_type i;
+
+    basic_iterator(M *m, size_type i) : m(m), i(i) {}
+
+  public:
+    using value_type = T;
+    using difference_type = ssize_t;
+    using pointer = U *;
+    using reference = U &;
+    using iterator_category = std::random_access_iterator_tag;
+
+    basic_iterator() : m(nullptr), i(0) {}
+    template <typename M2, typename U2> basic_iterator(basic_iterator<M2, U2> const &o) : m(o.m), i(o.i) {}
+
+    reference operator*() const { return (*m)[i]; }
+    pointer operator->() const { return &(*m)[i]; }
+    reference operator[](difference_type n) const { return (*m)[i + n]; }
+
+    basic_iterator &operator++() {
+      i++;
+      return *this;
+    }
+
+    basic_iterator operator++(int) {
+      basic_iterator copy = *this;
+      i++;
+      return copy;
+    }
+
+    basic_iterator &operator--() {
+      i--;
+      return *this;
+    }
+
+    basic_iterator operator--(int) {
+      basic_iterator copy = *this;
+      i--;
+      return copy;
+    }
+
+    basic_iterator &operator+=(difference_type n) {
+      i += n;
+      return *this;
+    }
+
+    basic_iterator &operator-=(difference_type n) {
+      i -= n;
+      return *this;
+    }
+
+    basic_iterator operator+(difference_type n) const { return basic_iterator(m, i + n); }
+    basic_iterator operator-(difference_type n) const { return basic_iterator(m, i - n); }
+    difference_type operator-(basic_iterator const &o) const { return i - o.i; }
+
+    bool operator==(basic_iterator const &o) const { return m == o.m && i == o.i; }
+    bool operator!=(basic_iterator const &o) const { return m != o.m || i != o.i; }
+    bool operator<(basic_iterator const &o) const { return i < o.i; }
+    bool operator<=(basic_iterator const &o) const { return i <= o.i; }
+    bool operator>(basic_iterator const &o) const { return i > o.i; }
+    bool operator>=(basic_iterator const &o) const { return i >= o.i; }
+  };
+
+public:
+  using iterator = basic_iterator<compact_monoque<T, Allocator>, T>;
+  using const_iterator = basic_iterator<compact_monoque<T, Allocator> const, T const>;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  compact_monoque() : compact_monoque(Allocator()) {}
+
+  explicit compact_monoque(allocator_type const &alloc) : Allocator(alloc), blocks_pv(typename index_type_pv::allocator_type(alloc)), size_pv(0), capacity_pv(0) {}
+
+  template <typename It, typename = typename std::iterator_traits<It>::iterator_category>
+  compact_monoque(It first, It last, allocator_type const &alloc = Allocator()) : compact_monoque(alloc) {
+    for (; first != last; ++first)
+      emplace_back(*first);
+  }
+
+  compact_monoque(std::initializer_list<T> il, allocator_type const &alloc = Allocator()) : compact_monoque(il.begin(), il.end(), alloc) {}
+
+  compact_monoque(compact_monoque const &other) : compact_monoque(traits_pv::select_on_container_copy_construction(other.get_allocator())) {
+    other.for_each_segment([&](T const *p, size_t n) {
+      for (size_t i = 0; i != n; i++)
+        push_back(p[i]);
+    });
+  }
+
+  compact_monoque(compact_monoque &&other) : compact_monoque(other.get_allocator()) { swap(other); }
+
+  compact_monoque &operator=(compact_monoque other) {
+    swap(other);
+    return *this;
+  }
+
+  ~compact_monoque() {
+    clear();
+    while (capacity_pv != 0)
+      close_block_pv();
+  }
+
+  allocator_type const &get_allocator() const { return *this; }
+
+  bool empty() const { return size_pv == 0; }
+  size_type size() const { return size_pv; }
+
+  // Elements the data blocks can hold; the index adds one pointer per data block on top.
+  size_type capacity() const { return capacity_pv; }
+  size_type block_count() const { return blocks_pv.size(); }
+
+  inline T &operator[](size_type at) { return *locate_pv(at); }
+  inline T const &operator[](size_type at) const { return *locate_pv(at); }
+
+  reference at(size_type pos) {
+    if (!(pos < size()))
+      throw std::out_of_range("compact_monoque::at");
+    return (*this)[pos];
+  }
+
+  const_reference at(size_type pos) const {
+    if (!(pos < size()))
+      throw std::out_of_range("compact_monoque::at");
+    return (*this)[pos];
+  }
+
+  reference front() { return *blocks_pv[0]; }
+  const_reference front() const { return *blocks_pv[0]; }
+  reference back() { return *locate_pv(size_pv - 1); }
+  const_reference back() const { return *locate_pv(size_pv - 1); }
+
+  template <typename... Ts> void emplace_back(Ts &&... ts) {
+    if (rpnx_unlikely(size_pv == capacity_pv))
+      open_block_pv();
+    traits_pv::construct(*this, locate_pv(size_pv), std::forward<Ts>(ts)...);
+    size_pv++;
+  }
+
+  void push_back(T const &v) { emplace_back(v); }
+  void push_back(T &&v) { emplace_back(std::move(v)); }
+
+  // Frees a data block once the block before it has emptied too, so alternating push_back / pop_back never thrashes.
+  void pop_back() {
+    using namespace std;
+    assert(size_pv != 0);
+    size_pv--;
+    size_t d, o;
+    tie(d, o) = layout::index(size_pv);
+    traits_pv::destroy(*this, blocks_pv[d] + o);
+    if (rpnx_unlikely(o == 0 && d + 2 == blocks_pv.size()))
+      close_block_pv();
+  }
+
+  // Destroys every element but keeps the data blocks.
+  void clear() {
+    if (!std::is_trivially_destructible<T>::value)
+      for_each_segment([this](T *p, size_t n) {
+        for (size_t i = 0; i != n; i++)
+          traits_pv::destroy(*this, p + i);
+      });
+    size_pv = 0;
+  }
+
+  // Frees every data block past the one holding the last element.
+  void shrink_to_fit() {
+    while (capacity_pv != 0 && capacity_pv - layout::sizeat(capacity_pv - 1) >= size_pv)
+      close_block_pv();
+    blocks_pv.shink_to_fit();
+  }
+
+  // Calls f(T *data, size_t n) once per contiguous run, in order, covering [first, last).
+  template <typename F> void for_each_segment(size_t first, size_t last, F &&f) { for_each_segment_pv(*this, first, last, f); }
+  template <typename F> void for_each_segment(size_t first, size_t last, F &&f) const { for_each_segment_pv(*this, first, last, f); }
+  template <typename F> void for_each_segment(F &&f) { for_each_segment_pv(*this, 0, size_pv, f); }
+  template <typename F> void for_each_segment(F &&f) const { for_each_segment_pv(*this, 0, size_pv, f); }
+
+  iterator begin() { return iterator(this, 0); }
+  iterator end() { return iterator(this, size_pv); }
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, size_pv); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+  reverse_iterator rbegin() { return reverse_iterator(end()); }
+  reverse_iterator rend() { return reverse_iterator(begin()); }
+
+  // Allocators are exchanged only if they propagate on swap; otherwise they must compare equal.
+  void swap(compact_monoque &other) {
+    if constexpr (traits_pv::propagate_on_container_swap::value) {
+      using std::swap;
+      swap(static_cast<allocator_type &>(*this), static_cast<allocator_type &>(other));
+    }
+    assert(traits_pv::propagate_on_container_swap::value || get_allocator() == other.get_allocator());
+    blocks_pv.swap(other.blocks_pv);
+    std::swap(size_pv, other.size_pv);
+    std::swap(capacity_pv, other.capacity_pv);
+  }
+
+  friend void swap(compact_monoque &a, compact_monoque &b) { a.swap(b); }
+};
+} // namespace rpnx
+
+#endif
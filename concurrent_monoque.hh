@@ -0,0 +1,270 @@
+/*
+Concurrent Monoque
+
+Copyright (c) 2017, 2018 Ryan P. Nicholl <exaeta@protonmail.com> http://rpnx.net/
+ -- Please let me know if you find this structure useful, thanks!
+
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef RPNX_CONCURRENT_MONOQUE_HH
+#define RPNX_CONCURRENT_MONOQUE_HH
+
+#include "monoque.hh"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <thread>
+#include <utility>
+
+/*
+  A monoque that many threads may append to at once without a lock.
+
+  Each producer claims an index with a fetch_add on the size. The producer
+  that claims the first index of block k also installs block k + 1, so by the
+  time indices in a block are claimed it is normally already there; only if
+  that install has not landed yet does a producer allocate the block itself
+  and race to install it with a CAS. Installing a block is just the
+  allocation: nothing in it is written but a two-counter header.
+
+  Each block carries a readiness bitmap, one bit per element, set (release)
+  once the element is constructed, so any thread may read an index after
+  published(i) returns true. Consecutive indices map to different 64 byte
+  lines of the bitmap, so neighbouring producers do not fetch_or the same
+  word. The bitmap of block k + 1 is cleared one line per push by the pushes
+  into block k, which outnumber its lines; a push that reaches a block whose
+  bitmap is not yet clear finishes the job (only possible for the smallest
+  blocks, or when the ahead-of-time install failed) and waits for lines
+  another producer is still clearing. Elements are never relocated, and
+  references stay valid until the container is destroyed. Each element costs
+  sizeof(T) plus that one bit, rounded up to a 512 bit line per block.
+
+  size() counts claimed indices; some of them may still be under construction.
+  If a constructor throws, its index stays claimed and is never published.
+
+  The allocator must be safe to call from several threads.
+ */
+
+namespace rpnx {
+template <typename T, typename Allocator = std::allocator<T>> class concurrent_monoque {
+public:
+  using value_type = T;
+  using allocator_type = Allocator;
+  using size_type = size_t;
+  using reference = T &;
+  using const_reference = T const &;
+  using layout = monoque_layout;
+
+private:
+  using word_pv = std::atomic<uint64_t>;
+
+  // Progress of clearing a block's bitmap, in lines of line_words_pv words.
+  struct header_pv {
+    std::atomic<size_t> claimed;
+    std::atomic<size_t> cleared;
+  };
+
+  static constexpr size_t line_words_pv = 8;
+  static constexpr size_t max_pv(size_t a, size_t b) { return a > b ? a : b; }
+  static constexpr size_t unit_align_pv = max_pv(alignof(T), max_pv(alignof(word_pv), alignof(header_pv)));
+
+  // A block is one allocation: the header, the readiness bitmap, then the elements.
+  struct alignas(unit_align_pv) unit_pv {
+    unsigned char bytes[unit_align_pv];
+  };
+
+  using unit_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<unit_pv>;
+  using unit_traits = std::allocator_traits<unit_allocator>;
+
+  unit_allocator alloc_pv;
+  std::atomic<size_t> size_pv;
+  std::array<std::atomic<unit_pv *>, sizeof(T *) * 8> data_pv;
+
+  static size_t lines_pv(size_t k) { return (layout::segment_capacity(k) + line_words_pv * 64 - 1) / (line_words_pv * 64); }
+  static size_t header_units_pv() { return (sizeof(header_pv) + sizeof(unit_pv) - 1) / sizeof(unit_pv); }
+  static size_t bitmap_units_pv(size_t k) { return (lines_pv(k) * line_words_pv * sizeof(word_pv) + sizeof(unit_pv) - 1) / sizeof(unit_pv); }
+  static size_t block_units_pv(size_t k) {
+    return header_units_pv() + bitmap_units_pv(k) + (layout::segment_capacity(k) * sizeof(T) + sizeof(unit_pv) - 1) / sizeof(unit_pv);
+  }
+
+  static header_pv *header_of_pv(unit_pv *blk) { return reinterpret_cast<header_pv *>(blk); }
+  static word_pv *ready_pv(unit_pv *blk) { return reinterpret_cast<word_pv *>(blk + header_units_pv()); }
+  static T *elements_pv(unit_pv *blk, size_t k) { return reinterpret_cast<T *>(blk + header_units_pv() + bitmap_units_pv(k)); }
+
+  // The bitmap word and bit of element i2 of block k: element i2 goes to line i2 % lines, so neighbours do not share a line.
+  static word_pv &ready_word_pv(unit_pv *blk, size_t k, size_t i2, uint64_t &bit) {
+    size_t lines = lines_pv(k), r = i2 / lines;
+    bit = uint64_t(1) << (r / line_words_pv);
+    return ready_pv(blk)[(i2 % lines) * line_words_pv + r % line_words_pv];
+  }
+
+  unit_pv *allocate_block_pv(size_t k) {
+    unit_pv *blk = unit_traits::allocate(alloc_pv, block_units_pv(k));
+    header_pv *h = ::new (static_cast<void *>(blk)) header_pv;
+    h->claimed.store(0, std::memory_order_relaxed);
+    h->cleared.store(0, std::memory_order_relaxed);
+    return blk;
+  }
+
+  // Clears the next unclaimed line of block k's bitmap; false once every line has been claimed.
+  static bool clear_line_pv(unit_pv *blk, size_t k) {
+    header_pv &h = *header_of_pv(blk);
+    if (h.claimed.load(std::memory_order_relaxed) >= lines_pv(k))
+      return false;
+    size_t line = h.claimed.fetch_add(1, std::memory_order_relaxed);
+    if (line >= lines_pv(k))
+      return false;
+    for (size_t w = line * line_words_pv, e = w + line_words_pv; w != e; w++)
+      ::new (static_cast<void *>(ready_pv(blk) + w)) word_pv(0);
+    h.cleared.fetch_add(1, std::memory_order_release);
+    return true;
+  }
+
+  // Returns once block k's bitmap is clear, clearing what nobody has claimed yet.
+  static void await_cleared_pv(unit_pv *blk, size_t k) {
+    header_pv &h = *header_of_pv(blk);
+    if (rpnx_likely(h.cleared.load(std::memory_order_acquire) == lines_pv(k)))
+      return;
+    while (clear_line_pv(blk, k))
+      ;
+    while (h.cleared.load(std::memory_order_acquire) != lines_pv(k))
+      std::this_thread::yield();
+  }
+
+  static bool cleared_pv(unit_pv *blk, size_t k) { return header_of_pv(blk)->cleared.load(std::memory_order_acquire) == lines_pv(k); }
+
+  void free_block_pv(unit_pv *blk, size_t k) { unit_traits::deallocate(alloc_pv, blk, block_units_pv(k)); }
+
+  // Installs a fresh block k unless one is there already, and returns the installed block.
+  unit_pv *install_pv(size_t k) {
+    unit_pv *blk = data_pv[k].load(std::memory_order_acquire);
+    if (blk != nullptr)
+      return blk;
+    unit_pv *fresh = allocate_block_pv(k);
+    if (data_pv[k].compare_exchange_strong(blk, fresh, std::memory_order_acq_rel, std::memory_order_acquire))
+      return fresh;
+    free_block_pv(fresh, k);
+    return blk;
+  }
+
+  T *element_at_pv(size_t at) const {
+    using namespace std;
+    size_t i1, i2;
+    tie(i1, i2) = layout::index(at);
+    return elements_pv(data_pv[i1].load(std::memory_order_acquire), i1) + i2;
+  }
+
+  unit_pv *block_pv(size_t k) {
+    unit_pv *blk = data_pv[k].load(std::memory_order_acquire);
+    if (rpnx_likely(blk != nullptr))
+      return blk;
+    // The ahead-of-time install of block k has not landed, or failed; install it here.
+    return install_pv(k);
+  }
+
+public:
+  concurrent_monoque() : concurrent_monoque(Allocator()) {}
+
+  explicit concurrent_monoque(allocator_type const &alloc) : alloc_pv(alloc), size_pv(0) {
+    for (auto &x : data_pv)
+      x.store(nullptr, std::memory_order_relaxed);
+  }
+
+  concurrent_monoque(concurrent_monoque const &) = delete;
+  concurrent_monoque &operator=(concurrent_monoque const &) = delete;
+
+  // Not thread safe: no other thread may be using the container.
+  ~concurrent_monoque() {
+    for (size_t k = 0; k < data_pv.size(); k++) {
+      unit_pv *blk = data_pv[k].load(std::memory_order_acquire);
+      if (blk == nullptr)
+        continue;
+      // Nothing is constructed in a block before its bitmap is clear.
+      if (!std::is_trivially_destructible<T>::value && cleared_pv(blk, k))
+        for (size_t i = 0, n = layout::segment_capacity(k); i != n; i++) {
+          uint64_t bit;
+          if (ready_word_pv(blk, k, i, bit).load(std::memory_order_acquire) & bit)
+            elements_pv(blk, k)[i].~T();
+        }
+      free_block_pv(blk, k);
+    }
+  }
+
+  // Constructs a new element and returns its index. Safe to call from any number of threads.
+  template <typename... Ts> size_type emplace_back(Ts &&... ts) {
+    using namespace std;
+    size_t at = size_pv.fetch_add(1, std::memory_order_relaxed);
+
+    size_t i1, i2;
+    tie(i1, i2) = layout::index(at);
+    unit_pv *blk = block_pv(i1);
+    await_cleared_pv(blk, i1);
+    if (rpnx_likely(i1 + 1 < data_pv.size())) {
+      unit_pv *next = data_pv[i1 + 1].load(std::memory_order_acquire);
+      if (rpnx_unlikely(i2 == 0 && next == nullptr)) {
+        // Best effort: if it fails, whoever first needs block i1 + 1 installs it.
+        try {
+          next = install_pv(i1 + 1);
+        } catch (...) {
+        }
+      }
+      // Each push into block i1 clears at most one line of the next block's bitmap.
+      if (next != nullptr)
+        clear_line_pv(next, i1 + 1);
+    }
+    ::new (static_cast<void *>(elements_pv(blk, i1) + i2)) T(std::forward<Ts>(ts)...);
+    uint64_t bit;
+    ready_word_pv(blk, i1, i2, bit).fetch_or(bit, std::memory_order_release);
+    return at;
+  }
+
+  size_type push_back(T const &t) { return emplace_back(t); }
+  size_type push_back(T &&t) { return emplace_back(std::move(t)); }
+
+  // True once the element at index at has been constructed and may be read.
+  bool published(size_type at) const {
+    using namespace std;
+    if (!(at < size()))
+      return false;
+    size_t i1, i2;
+    tie(i1, i2) = layout::index(at);
+    unit_pv *blk = data_pv[i1].load(std::memory_order_acquire);
+    if (blk == nullptr || !cleared_pv(blk, i1))
+      return false;
+    uint64_t bit;
+    return (ready_word_pv(blk, i1, i2, bit).load(std::memory_order_acquire) & bit) != 0;
+  }
+
+  // Requires published(at).
+  T &operator[](size_type at) { return *element_at_pv(at); }
+  T const &operator[](size_type at) const { return *element_at_pv(at); }
+
+  T *try_get(size_type at) { return published(at) ? element_at_pv(at) : nullptr; }
+  T const *try_get(size_type at) const { return published(at) ? element_at_pv(at) : nullptr; }
+
+  size_type size() const { return size_pv.load(std::memory_order_acquire); }
+  bool empty() const { return size() == 0; }
+
+  allocator_type get_allocator() const { return allocator_type(alloc_pv); }
+};
+} // namespace rpnx
+
+#endif
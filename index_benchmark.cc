@@ -0,0 +1,191 @@
+/*
+"Monoque Index Benchmark" http://rpnx.net/monoque.pdf
+Copyright (c) 2017 Ryan P. Nicholl <r.p.nicholl@gmail.com> http://rpnx.net/
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+  Compares the monoque index backends (see basic_monoque_layout) on this
+  machine, so the default can be chosen per target from data. Build it with
+  the flags the target will use; monoque_index_bmi2 only differs from
+  monoque_index_clz when built with -mlzcnt -mbmi2 (or -march=native on a
+  CPU that has them).
+
+  For each backend, in nanoseconds per index:
+
+    decompose   index1 + index2 of independent random indices (throughput)
+    chain       each index depends on the previous decomposition (latency)
+    random      operator[] on a cache resident monoque<size_t>, random indices
+    chase       operator[] following a random cycle stored in the monoque
+    run_at      8 neighbouring elements read through one run_at() call,
+                per element, against 8 operator[] calls
+
+  Usage: index_benchmark [--size=N] [--ops=N] [--runs=N]
+ */
+
+#include "monoque.hh"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace {
+volatile size_t sink;
+
+struct options {
+  size_t size = size_t(1) << 16;
+  size_t ops = size_t(1) << 24;
+  size_t runs = 5;
+};
+
+// Best of opt.runs timings of f(), in nanoseconds per operation.
+template <typename F> double best_pv(options const &opt, size_t ops, F &&f) {
+  using namespace std::chrono;
+  double best = std::numeric_limits<double>::max();
+  for (size_t r = 0; r < opt.runs; r++) {
+    auto start = steady_clock::now();
+    sink += f();
+    auto end = steady_clock::now();
+    best = std::min(best, double(duration_cast<nanoseconds>(end - start).count()) / double(ops));
+  }
+  return best;
+}
+
+template <typename Index> void bench_backend(char const *name, options const &opt, std::vector<size_t> const &random) {
+  using layout = rpnx::basic_monoque_layout<2, Index>;
+  using monoque = rpnx::monoque<size_t, std::allocator<size_t>, 2, false, rpnx::no_monoque_stats, Index>;
+  size_t mask = random.size() - 1;
+
+  double decompose = best_pv(opt, opt.ops, [&] {
+    size_t t = 0;
+    for (size_t i = 0; i < opt.ops; i++)
+      t += layout::index1(random[i & mask]) ^ layout::index2(random[i & mask]);
+    return t;
+  });
+
+  double chain = best_pv(opt, opt.ops, [&] {
+    size_t n = 12345;
+    for (size_t i = 0; i < opt.ops; i++)
+      n = (layout::index1(n) + layout::index2(n)) ^ random[i & mask];
+    return n;
+  });
+
+  // A random cycle through [0, size) for the pointer chase.
+  monoque m;
+  std::vector<size_t> order(opt.size);
+  std::iota(order.begin(), order.end(), size_t(0));
+  std::shuffle(order.begin(), order.end(), std::mt19937_64(7));
+  m.resize(opt.size);
+  for (size_t i = 0; i < opt.size; i++)
+    m[order[i]] = order[(i + 1) % opt.size];
+
+  double random_access = best_pv(opt, opt.ops, [&] {
+    size_t t = 0;
+    for (size_t i = 0; i < opt.ops; i++)
+      t += m[random[i & mask] % opt.size];
+    return t;
+  });
+
+  double chase = best_pv(opt, opt.ops, [&] {
+    size_t n = 0;
+    for (size_t i = 0; i < opt.ops; i++)
+      n = m[n];
+    return n;
+  });
+
+  size_t groups = opt.ops / 8;
+  double neighbours = best_pv(opt, groups * 8, [&] {
+    size_t t = 0;
+    for (size_t g = 0; g < groups; g++) {
+      size_t i = random[g & mask] % (opt.size - 8);
+      for (size_t j = 0; j < 8; j++)
+        t += m[i + j];
+    }
+    return t;
+  });
+
+  double run_at = best_pv(opt, groups * 8, [&] {
+    size_t t = 0;
+    for (size_t g = 0; g < groups; g++) {
+      size_t i = random[g & mask] % (opt.size - 8);
+      auto run = m.run_at(i);
+      if (rpnx_likely(run.size() >= 8))
+        for (size_t j = 0; j < 8; j++)
+          t += run[j];
+      else
+        for (size_t j = 0; j < 8; j++)
+          t += m[i + j];
+    }
+    return t;
+  });
+
+  std::cout.width(22);
+  std::cout << std::left << name;
+  for (double v : {decompose, chain, random_access, chase, neighbours, run_at}) {
+    std::cout.width(12);
+    std::cout << std::right << v;
+  }
+  std::cout << std::endl;
+}
+
+bool parse_size(char const *arg, char const *prefix, size_t &out) {
+  size_t len = strlen(prefix);
+  if (strncmp(arg, prefix, len) != 0)
+    return false;
+  out = size_t(std::stoull(arg + len));
+  return true;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  options opt;
+  for (int i = 1; i < argc; i++) {
+    if (!parse_size(argv[i], "--size=", opt.size) && !parse_size(argv[i], "--ops=", opt.ops) && !parse_size(argv[i], "--runs=", opt.runs)) {
+      std::cerr << "usage: " << argv[0] << " [--size=N] [--ops=N] [--runs=N]" << std::endl;
+      return 2;
+    }
+  }
+  opt.size = std::max(opt.size, size_t(16));
+  opt.runs = std::max(opt.runs, size_t(1));
+
+  // Indices spread over every block size up to 2^32, so no backend is favoured by a narrow range.
+  std::mt19937_64 r;
+  std::vector<size_t> random(size_t(1) << 16);
+  for (auto &x : random)
+    x = size_t(r()) >> (32 + r() % 32);
+
+  std::cout.precision(3);
+  std::cout << std::fixed;
+  std::cout << "nanoseconds per index     decompose       chain      random       chase  operator[]      run_at" << std::endl;
+  bench_backend<rpnx::monoque_index_clz>("monoque_index_clz", opt, random);
+#if defined(__LZCNT__) && defined(__BMI2__)
+  bench_backend<rpnx::monoque_index_bmi2>("monoque_index_bmi2", opt, random);
+#else
+  std::cout << "monoque_index_bmi2    (not built with -mlzcnt -mbmi2, same as clz)" << std::endl;
+#endif
+  bench_backend<rpnx::monoque_index_table>("monoque_index_table", opt, random);
+  bench_backend<rpnx::monoque_index_32>("monoque_index_32", opt, random);
+}
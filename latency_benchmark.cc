@@ -0,0 +1,583 @@
+/*
+"Monoque Latency Benchmark" http://rpnx.net/monoque.pdf
+Copyright (c) 2017 Ryan P. Nicholl <r.p.nicholl@gmail.com> http://rpnx.net/
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+  Per-operation latency distributions for vector, deque and monoque.
+
+  benchmark.cc reports best-of-n averages; this one reports p50, p99, p99.9
+  and max, which is where monoque's bounded push_back shows. For every
+  element type (8, 64 and 256 byte PODs and std::string) and every container
+  size from --min-size to --max-size (stepping by 4x), it measures:
+
+    push_back, emplace_back, pop_back   each call timed on its own
+    random, sequential, iterate         timed in batches of 64 accesses,
+                                        each batch recorded as 64 samples of
+                                        its average, since a single access is
+                                        shorter than the clock overhead
+    assign                              one sample per --reps repetition,
+                                        per element
+    heap_pop_push                       top()+pop()+push() on priority_queue
+                                        over each container, and on
+                                        monoque_heap
+
+  Latencies are in nanoseconds with the calibrated clock overhead removed,
+  kept in a log-linear histogram with about 3% resolution.
+
+  Usage: latency_benchmark [--format=text|csv|json] [--min-size=N] [--max-size=N]
+                           [--max-bytes=N] [--ops=N] [--reps=N] [--counters]
+
+  --counters adds cycles, instructions and cache misses per operation from
+  perf_event_open (Linux only; needs perf_event_paranoid <= 2 or CAP_PERFMON).
+ */
+
+#include "monoque.hh"
+#include "monoque_heap.hh"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <inttypes.h>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <stdio.h>
+#include <string>
+#include <string.h>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+volatile size_t vol = 0;
+
+namespace {
+
+inline uint64_t now_ns() {
+  return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Buckets of 32 linear steps per power of two.
+class histogram {
+  static constexpr size_t sub_bits = 5;
+  static constexpr size_t sub = size_t(1) << sub_bits;
+  std::vector<uint64_t> buckets_pv;
+  uint64_t count_pv = 0;
+  uint64_t max_pv = 0;
+  double sum_pv = 0;
+
+  static size_t bucket_pv(uint64_t v) {
+    if (v < sub)
+      return size_t(v);
+    size_t e = size_t(63 - __builtin_clzll(v)) - sub_bits + 1;
+    return e * sub + size_t(v >> e) - sub;
+  }
+
+  static uint64_t value_pv(size_t b) {
+    if (b < sub)
+      return b;
+    size_t e = b / sub;
+    return ((b % sub) + sub) << e;
+  }
+
+public:
+  histogram() : buckets_pv(64 * sub) {}
+
+  void record(uint64_t v, uint64_t times = 1) {
+    buckets_pv[bucket_pv(v)] += times;
+    count_pv += times;
+    sum_pv += double(v) * double(times);
+    max_pv = std::max(max_pv, v);
+  }
+
+  uint64_t count() const { return count_pv; }
+  uint64_t max() const { return max_pv; }
+  double mean() const { return count_pv == 0 ? 0 : sum_pv / double(count_pv); }
+
+  // Lower bound of the bucket holding the q-quantile.
+  uint64_t percentile(double q) const {
+    uint64_t want = uint64_t(q * double(count_pv));
+    uint64_t seen = 0;
+    for (size_t b = 0; b != buckets_pv.size(); b++) {
+      seen += buckets_pv[b];
+      if (seen > want)
+        return std::min(value_pv(b), max_pv);
+    }
+    return max_pv;
+  }
+};
+
+uint64_t clock_overhead_pv;
+
+uint64_t calibrate_clock() {
+  uint64_t best = ~uint64_t(0);
+  for (int i = 0; i < 10000; i++) {
+    uint64_t a = now_ns();
+    uint64_t b = now_ns();
+    best = std::min(best, b - a);
+  }
+  return best;
+}
+
+inline uint64_t elapsed(uint64_t start, uint64_t end) {
+  uint64_t d = end - start;
+  return d > clock_overhead_pv ? d - clock_overhead_pv : 0;
+}
+
+// Hardware counters for one measured section, or nothing when unavailable.
+class counters {
+  int fd_pv[3] = {-1, -1, -1};
+  uint64_t values_pv[3] = {0, 0, 0};
+
+public:
+  static bool &enabled() {
+    static bool on = false;
+    return on;
+  }
+
+  counters() {
+#if defined(__linux__)
+    if (!enabled())
+      return;
+    uint64_t const config[3] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+    for (int i = 0; i != 3; i++) {
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = config[i];
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      fd_pv[i] = int(syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fd_pv[0], 0));
+    }
+    if (fd_pv[0] < 0) {
+      std::cerr << "perf_event_open failed, hardware counters disabled" << std::endl;
+      enabled() = false;
+      return;
+    }
+    ioctl(fd_pv[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+#endif
+  }
+
+  ~counters() {
+#if defined(__linux__)
+    for (int fd : fd_pv)
+      if (fd >= 0)
+        close(fd);
+#endif
+  }
+
+  // Counts accumulate over every start()/stop() pair of one counters object.
+  void start() {
+#if defined(__linux__)
+    if (fd_pv[0] >= 0)
+      ioctl(fd_pv[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+  }
+
+  void stop() {
+#if defined(__linux__)
+    if (fd_pv[0] < 0)
+      return;
+    ioctl(fd_pv[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    for (int i = 0; i != 3; i++)
+      if (fd_pv[i] < 0 || read(fd_pv[i], &values_pv[i], sizeof(uint64_t)) != sizeof(uint64_t))
+        values_pv[i] = 0;
+#endif
+  }
+
+  bool valid() const { return fd_pv[0] >= 0; }
+  uint64_t cycles() const { return values_pv[0]; }
+  uint64_t instructions() const { return values_pv[1]; }
+  uint64_t cache_misses() const { return values_pv[2]; }
+};
+
+struct options {
+  std::string format = "text";
+  size_t min_size = size_t(1) << 10;
+  size_t max_size = size_t(1) << 22;
+  size_t max_bytes = size_t(1) << 30;
+  size_t ops = size_t(1) << 20;
+  size_t reps = 16;
+};
+
+struct result {
+  std::string container;
+  std::string element;
+  size_t element_bytes;
+  size_t size;
+  std::string op;
+  histogram h;
+  bool has_counters = false;
+  double cycles = 0, instructions = 0, cache_misses = 0;
+};
+
+class reporter {
+  std::string format_pv;
+  bool first_pv = true;
+
+public:
+  explicit reporter(std::string format) : format_pv(format) {
+    if (format_pv == "csv")
+      std::cout << "container,element,element_bytes,size,op,samples,mean_ns,p50_ns,p99_ns,p999_ns,max_ns,cycles,instructions,cache_misses" << std::endl;
+    else if (format_pv == "json")
+      std::cout << "[" << std::endl;
+    else
+      std::cout << "container    element      size       op              samples      mean     p50     p99   p99.9        max" << std::endl;
+  }
+
+  ~reporter() {
+    if (format_pv == "json")
+      std::cout << std::endl << "]" << std::endl;
+  }
+
+  void emit(result const &r) {
+    histogram const &h = r.h;
+    if (format_pv == "csv") {
+      std::cout << r.container << ',' << r.element << ',' << r.element_bytes << ',' << r.size << ',' << r.op << ',' << h.count() << ',' << h.mean() << ','
+                << h.percentile(0.5) << ',' << h.percentile(0.99) << ',' << h.percentile(0.999) << ',' << h.max() << ',';
+      if (r.has_counters)
+        std::cout << r.cycles << ',' << r.instructions << ',' << r.cache_misses;
+      else
+        std::cout << ",,";
+      std::cout << std::endl;
+    } else if (format_pv == "json") {
+      std::cout << (first_pv ? "  " : ",\n  ") << "{\"container\": \"" << r.container << "\", \"element\": \"" << r.element
+                << "\", \"element_bytes\": " << r.element_bytes << ", \"size\": " << r.size << ", \"op\": \"" << r.op << "\", \"samples\": " << h.count()
+                << ", \"mean_ns\": " << h.mean() << ", \"p50_ns\": " << h.percentile(0.5) << ", \"p99_ns\": " << h.percentile(0.99)
+                << ", \"p999_ns\": " << h.percentile(0.999) << ", \"max_ns\": " << h.max();
+      if (r.has_counters)
+        std::cout << ", \"cycles\": " << r.cycles << ", \"instructions\": " << r.instructions << ", \"cache_misses\": " << r.cache_misses;
+      std::cout << "}";
+      first_pv = false;
+    } else {
+      char line[256];
+      snprintf(line, sizeof(line), "%-12s %-12s %-10zu %-15s %8" PRIu64 " %9.1f %7" PRIu64 " %7" PRIu64 " %7" PRIu64 " %10" PRIu64, r.container.c_str(),
+               r.element.c_str(), r.size, r.op.c_str(), h.count(), h.mean(), h.percentile(0.5), h.percentile(0.99), h.percentile(0.999), h.max());
+      std::cout << line;
+      if (r.has_counters)
+        std::cout << "  cycles/op " << r.cycles << " instr/op " << r.instructions << " misses/op " << r.cache_misses;
+      std::cout << std::endl;
+    }
+  }
+};
+
+template <size_t N> struct pod {
+  uint64_t key;
+  char pad[N - sizeof(uint64_t)];
+  bool operator<(pod const &o) const { return key < o.key; }
+};
+
+template <> struct pod<8> {
+  uint64_t key;
+  bool operator<(pod const &o) const { return key < o.key; }
+};
+
+template <typename T> struct element_traits;
+
+template <size_t N> struct element_traits<pod<N>> {
+  static std::string name() { return "pod" + std::to_string(N); }
+  static pod<N> make(uint64_t x) {
+    pod<N> p = {};
+    p.key = x;
+    return p;
+  }
+  static uint64_t key(pod<N> const &p) { return p.key; }
+};
+
+// Long enough to defeat the small string optimization, so every element owns a heap block.
+template <> struct element_traits<std::string> {
+  static std::string name() { return "string"; }
+  static std::string make(uint64_t x) { return std::string("monoque-latency-") + std::to_string(x); }
+  static uint64_t key(std::string const &s) { return s.size(); }
+};
+
+template <typename C> struct container_name;
+template <typename T> struct container_name<std::vector<T>> {
+  static char const *get() { return "vector"; }
+};
+template <typename T> struct container_name<std::deque<T>> {
+  static char const *get() { return "deque"; }
+};
+template <typename T> struct container_name<rpnx::monoque<T>> {
+  static char const *get() { return "monoque"; }
+};
+
+template <typename T> result make_result(char const *container, size_t size, char const *op) {
+  result r;
+  r.container = container;
+  r.element = element_traits<T>::name();
+  r.element_bytes = sizeof(T);
+  r.size = size;
+  r.op = op;
+  return r;
+}
+
+void take_counters(result &r, counters const &c, uint64_t ops) {
+  if (!c.valid() || ops == 0)
+    return;
+  r.has_counters = true;
+  r.cycles = double(c.cycles()) / double(ops);
+  r.instructions = double(c.instructions()) / double(ops);
+  r.cache_misses = double(c.cache_misses()) / double(ops);
+}
+
+constexpr size_t batch = 64;
+
+template <typename C> void bench_container(reporter &out, options const &opt, size_t n, std::vector<size_t> const &random) {
+  using T = typename C::value_type;
+  using traits = element_traits<T>;
+  char const *name = container_name<C>::get();
+  std::vector<T> source;
+  for (size_t i = 0; i < n; i++)
+    source.push_back(traits::make(i));
+
+  {
+    result r = make_result<T>(name, n, "push_back");
+    counters pc;
+    for (size_t rep = 0; rep < 3; rep++) {
+      C c;
+      pc.start();
+      for (size_t i = 0; i < n; i++) {
+        uint64_t a = now_ns();
+        c.push_back(source[i]);
+        uint64_t b = now_ns();
+        r.h.record(elapsed(a, b));
+      }
+      pc.stop();
+      vol += traits::key(c.back());
+    }
+    take_counters(r, pc, 3 * n);
+    out.emit(r);
+  }
+
+  {
+    result r = make_result<T>(name, n, "emplace_back");
+    counters pc;
+    for (size_t rep = 0; rep < 3; rep++) {
+      C c;
+      pc.start();
+      for (size_t i = 0; i < n; i++) {
+        uint64_t a = now_ns();
+        c.emplace_back(traits::make(i));
+        uint64_t b = now_ns();
+        r.h.record(elapsed(a, b));
+      }
+      pc.stop();
+      vol += traits::key(c.back());
+    }
+    take_counters(r, pc, 3 * n);
+    out.emit(r);
+  }
+
+  C c(source.begin(), source.end());
+  size_t ops = std::max(batch, opt.ops / batch * batch);
+
+  {
+    result r = make_result<T>(name, n, "random");
+    counters pc;
+    pc.start();
+    for (size_t i = 0; i < ops; i += batch) {
+      uint64_t a = now_ns();
+      size_t acc = 0;
+      for (size_t j = 0; j < batch; j++)
+        acc += traits::key(c[random[(i + j) % random.size()] % n]);
+      uint64_t b = now_ns();
+      vol += acc;
+      r.h.record(elapsed(a, b) / batch, batch);
+    }
+    pc.stop();
+    take_counters(r, pc, ops);
+    out.emit(r);
+  }
+
+  {
+    result r = make_result<T>(name, n, "sequential");
+    counters pc;
+    pc.start();
+    for (size_t i = 0; i < ops; i += batch) {
+      uint64_t a = now_ns();
+      size_t acc = 0;
+      for (size_t j = 0; j < batch; j++)
+        acc += traits::key(c[(i + j) % n]);
+      uint64_t b = now_ns();
+      vol += acc;
+      r.h.record(elapsed(a, b) / batch, batch);
+    }
+    pc.stop();
+    take_counters(r, pc, ops);
+    out.emit(r);
+  }
+
+  {
+    result r = make_result<T>(name, n, "iterate");
+    counters pc;
+    pc.start();
+    size_t done = 0;
+    while (done < ops) {
+      auto it = c.begin(), end = c.end();
+      while (it != end && done < ops) {
+        uint64_t a = now_ns();
+        size_t acc = 0, j = 0;
+        for (; j < batch && it != end; j++, ++it)
+          acc += traits::key(*it);
+        uint64_t b = now_ns();
+        vol += acc;
+        r.h.record(elapsed(a, b) / j, j);
+        done += j;
+      }
+    }
+    pc.stop();
+    take_counters(r, pc, done);
+    out.emit(r);
+  }
+
+  {
+    result r = make_result<T>(name, n, "assign");
+    counters pc;
+    C d;
+    pc.start();
+    for (size_t rep = 0; rep < opt.reps; rep++) {
+      uint64_t a = now_ns();
+      d.assign(source.begin(), source.end());
+      uint64_t b = now_ns();
+      r.h.record(elapsed(a, b) / n);
+    }
+    pc.stop();
+    vol += d.size();
+    take_counters(r, pc, opt.reps * n);
+    out.emit(r);
+  }
+
+  {
+    result r = make_result<T>(name, n, "pop_back");
+    counters pc;
+    for (size_t rep = 0; rep < 3; rep++) {
+      C d(source.begin(), source.end());
+      pc.start();
+      for (size_t i = 0; i < n; i++) {
+        uint64_t a = now_ns();
+        d.pop_back();
+        uint64_t b = now_ns();
+        r.h.record(elapsed(a, b));
+      }
+      pc.stop();
+      vol += d.size();
+    }
+    take_counters(r, pc, 3 * n);
+    out.emit(r);
+  }
+}
+
+struct key_less {
+  template <typename T> bool operator()(T const &a, T const &b) const { return a < b; }
+};
+
+template <typename Q, typename T>
+void bench_heap(reporter &out, options const &opt, size_t n, std::vector<size_t> const &random, char const *name) {
+  using traits = element_traits<T>;
+  Q q;
+  for (size_t i = 0; i < n; i++)
+    q.push(traits::make(random[i % random.size()]));
+
+  result r = make_result<T>(name, n, "heap_pop_push");
+  counters pc;
+  pc.start();
+  for (size_t i = 0; i < opt.ops; i++) {
+    T v = traits::make(random[(i + 17) % random.size()]);
+    uint64_t a = now_ns();
+    vol += traits::key(q.top());
+    q.pop();
+    q.push(std::move(v));
+    uint64_t b = now_ns();
+    r.h.record(elapsed(a, b));
+  }
+  pc.stop();
+  take_counters(r, pc, opt.ops);
+  out.emit(r);
+}
+
+template <typename T> void bench_element(reporter &out, options const &opt, std::vector<size_t> const &random) {
+  for (size_t n = opt.min_size; n <= opt.max_size; n *= 4) {
+    // vector copies need up to twice the elements while growing.
+    if (n * sizeof(T) * 2 > opt.max_bytes)
+      break;
+    bench_container<std::vector<T>>(out, opt, n, random);
+    bench_container<std::deque<T>>(out, opt, n, random);
+    bench_container<rpnx::monoque<T>>(out, opt, n, random);
+    bench_heap<std::priority_queue<T, std::vector<T>, key_less>, T>(out, opt, n, random, "pq<vector>");
+    bench_heap<std::priority_queue<T, std::deque<T>, key_less>, T>(out, opt, n, random, "pq<deque>");
+    bench_heap<std::priority_queue<T, rpnx::monoque<T>, key_less>, T>(out, opt, n, random, "pq<monoque>");
+    bench_heap<rpnx::monoque_heap<T, key_less>, T>(out, opt, n, random, "monoque_heap");
+  }
+}
+
+bool parse_size(char const *arg, char const *flag, size_t &value) {
+  size_t len = strlen(flag);
+  if (strncmp(arg, flag, len) != 0)
+    return false;
+  value = size_t(strtoull(arg + len, nullptr, 0));
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  options opt;
+  for (int i = 1; i < argc; i++) {
+    char const *a = argv[i];
+    if (strncmp(a, "--format=", 9) == 0)
+      opt.format = a + 9;
+    else if (strcmp(a, "--counters") == 0)
+      counters::enabled() = true;
+    else if (!parse_size(a, "--min-size=", opt.min_size) && !parse_size(a, "--max-size=", opt.max_size) &&
+             !parse_size(a, "--max-bytes=", opt.max_bytes) && !parse_size(a, "--ops=", opt.ops) && !parse_size(a, "--reps=", opt.reps)) {
+      std::cerr << "usage: " << argv[0]
+                << " [--format=text|csv|json] [--min-size=N] [--max-size=N] [--max-bytes=N] [--ops=N] [--reps=N] [--counters]" << std::endl;
+      return 2;
+    }
+  }
+  if (opt.format != "text" && opt.format != "csv" && opt.format != "json") {
+    std::cerr << "unknown format " << opt.format << std::endl;
+    return 2;
+  }
+  opt.min_size = std::max(opt.min_size, size_t(1));
+  opt.reps = std::max(opt.reps, size_t(1));
+
+  clock_overhead_pv = calibrate_clock();
+
+  std::mt19937_64 r;
+  std::vector<size_t> random(size_t(1) << 20);
+  for (auto &x : random)
+    x = size_t(r());
+
+  reporter out(opt.format);
+  bench_element<pod<8>>(out, opt, random);
+  bench_element<pod<64>>(out, opt, random);
+  bench_element<pod<256>>(out, opt, random);
+  bench_element<std::string>(out, opt, random);
+}
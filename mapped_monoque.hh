@@ -0,0 +1,314 @@
+/*
+Mapped Monoque
+
+Copyright (c) 2017, 2018 Ryan P. Nicholl <exaeta@protonmail.com> http://rpnx.net/
+ -- Please let me know if you find this structure useful, thanks!
+
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef RPNX_MAPPED_MONOQUE_HH
+#define RPNX_MAPPED_MONOQUE_HH
+
+#include "monoque.hh"
+#include <array>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+/*
+  A monoque of trivially copyable elements whose blocks are mmap'd from a file.
+
+  The file is laid out in units of a fixed 64 KiB format alignment, a
+  multiple of every common page size, so a file written on a 4 KiB page host
+  maps the same way on a 16 KiB or 64 KiB one; the alignment is recorded in
+  the header and checked on open. The first unit holds the header and, packed
+  behind it, every small block that fits; each larger block starts on its own
+  unit boundary, so block k always sits at the same computable offset.
+  Opening an existing file maps the blocks it already holds and restores the
+  size without copying anything; pages are read in lazily on first touch.
+  push_back extends the file one block at a time.
+
+  The size stored in the header is only updated by sync() and the
+  destructor, so elements appended after the last sync() are lost if the
+  process dies.
+ */
+
+namespace rpnx {
+template <typename T> class mapped_monoque {
+  static_assert(std::is_trivially_copyable<T>::value, "mapped_monoque requires trivially copyable elements");
+
+public:
+  using value_type = T;
+  using size_type = size_t;
+  using reference = T &;
+  using const_reference = T const &;
+  using layout = monoque_layout;
+
+private:
+  struct header_pv {
+    char magic[8];
+    uint32_t version;
+    uint32_t element_size;
+    uint64_t size;
+    uint64_t alignment;
+  };
+
+  static constexpr uint32_t version_pv = 2;
+  static constexpr size_t align_pv = 65536;
+
+  int fd_pv;
+  size_t size_pv;
+  // Blocks [0, packed_pv) live inside the first unit, which is mapped once at head_pv.
+  size_t packed_pv;
+  char *head_pv;
+  std::array<T *, sizeof(T *) * 8> data_pv;
+  std::array<off_t, sizeof(T *) * 8 + 1> offset_pv;
+
+  [[noreturn]] static void fail_pv(char const *what) { throw std::system_error(errno, std::generic_category(), what); }
+
+  static size_t round_up_pv(size_t n, size_t to) { return (n + to - 1) / to * to; }
+
+  // Only meaningful for blocks with their own mapping, k >= packed_pv.
+  size_t block_bytes_pv(size_t k) const { return size_t(offset_pv[k + 1] - offset_pv[k]); }
+
+  void map_head_pv() {
+    void *p = mmap(nullptr, align_pv, PROT_READ | PROT_WRITE, MAP_SHARED, fd_pv, 0);
+    if (p == MAP_FAILED)
+      fail_pv("mapped_monoque: mmap");
+    head_pv = static_cast<char *>(p);
+    for (size_t k = 0; k < packed_pv; k++)
+      data_pv[k] = reinterpret_cast<T *>(head_pv + offset_pv[k]);
+  }
+
+  T *map_pv(size_t k) {
+    void *p = mmap(nullptr, block_bytes_pv(k), PROT_READ | PROT_WRITE, MAP_SHARED, fd_pv, offset_pv[k]);
+    if (p == MAP_FAILED)
+      fail_pv("mapped_monoque: mmap");
+    return static_cast<T *>(p);
+  }
+
+  T *extend_pv(size_t k) {
+    if (ftruncate(fd_pv, offset_pv[k + 1]) != 0)
+      fail_pv("mapped_monoque: ftruncate");
+    return data_pv[k] = map_pv(k);
+  }
+
+  void write_header_pv() {
+    header_pv h = {{'R', 'P', 'N', 'X', 'M', 'O', 'N', 'Q'}, version_pv, uint32_t(sizeof(T)), uint64_t(size_pv), uint64_t(align_pv)};
+    if (pwrite(fd_pv, &h, sizeof(h), 0) != ssize_t(sizeof(h)))
+      fail_pv("mapped_monoque: write header");
+  }
+
+  void close_pv() {
+    if (fd_pv < 0)
+      return;
+    for (size_t k = packed_pv; k < data_pv.size(); k++)
+      if (data_pv[k] != nullptr)
+        munmap(data_pv[k], block_bytes_pv(k));
+    if (head_pv != nullptr)
+      munmap(head_pv, align_pv);
+    ::close(fd_pv);
+    fd_pv = -1;
+  }
+
+public:
+  // Opens path, creating an empty monoque file if it does not exist.
+  explicit mapped_monoque(std::string const &path) : fd_pv(-1), size_pv(0), packed_pv(0), head_pv(nullptr) {
+    if (align_pv % size_t(sysconf(_SC_PAGESIZE)) != 0)
+      throw std::runtime_error("mapped_monoque: page size does not divide the format alignment");
+    data_pv.fill(nullptr);
+
+    // Small blocks are packed behind the header as long as they fit in the first unit.
+    size_t at = round_up_pv(sizeof(header_pv), alignof(T));
+    for (; packed_pv < data_pv.size(); packed_pv++) {
+      size_t bytes = layout::segment_capacity(packed_pv) * sizeof(T);
+      if (bytes > align_pv - at)
+        break;
+      offset_pv[packed_pv] = off_t(at);
+      at = round_up_pv(at + bytes, alignof(T));
+    }
+
+    offset_pv[packed_pv] = off_t(align_pv);
+    off_t const far = std::numeric_limits<off_t>::max();
+    for (size_t k = packed_pv; k < data_pv.size(); k++) {
+      size_t cap = layout::segment_capacity(k);
+      size_t bytes = round_up_pv(cap * sizeof(T), align_pv);
+      // Blocks that cannot fit in a file offset are never mapped.
+      if (offset_pv[k] == far || cap > size_t(far) / sizeof(T) || off_t(bytes) > far - offset_pv[k])
+        offset_pv[k + 1] = far;
+      else
+        offset_pv[k + 1] = offset_pv[k] + off_t(bytes);
+    }
+
+    fd_pv = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_pv < 0)
+      fail_pv("mapped_monoque: open");
+
+    try {
+      off_t file_size = lseek(fd_pv, 0, SEEK_END);
+      if (file_size == 0) {
+        if (ftruncate(fd_pv, off_t(align_pv)) != 0)
+          fail_pv("mapped_monoque: ftruncate");
+        write_header_pv();
+        map_head_pv();
+        return;
+      }
+
+      header_pv h;
+      if (pread(fd_pv, &h, sizeof(h), 0) != ssize_t(sizeof(h)) || memcmp(h.magic, "RPNXMONQ", 8) != 0 || h.version != version_pv)
+        throw std::runtime_error("mapped_monoque: not a monoque file");
+      if (h.element_size != sizeof(T))
+        throw std::runtime_error("mapped_monoque: element size mismatch");
+      if (h.alignment != align_pv)
+        throw std::runtime_error("mapped_monoque: alignment mismatch");
+      if (file_size < off_t(align_pv) || offset_pv[layout::segment_count(h.size)] > file_size)
+        throw std::runtime_error("mapped_monoque: file truncated");
+
+      size_pv = h.size;
+      map_head_pv();
+      for (size_t k = packed_pv; k < data_pv.size() && offset_pv[k + 1] <= file_size; k++)
+        data_pv[k] = map_pv(k);
+    } catch (...) {
+      close_pv();
+      throw;
+    }
+  }
+
+  mapped_monoque(mapped_monoque const &) = delete;
+  mapped_monoque &operator=(mapped_monoque const &) = delete;
+
+  mapped_monoque(mapped_monoque &&other) : fd_pv(-1), size_pv(0), packed_pv(other.packed_pv), head_pv(nullptr) {
+    data_pv.fill(nullptr);
+    offset_pv = other.offset_pv;
+    swap(other);
+  }
+
+  mapped_monoque &operator=(mapped_monoque &&other) {
+    swap(other);
+    return *this;
+  }
+
+  ~mapped_monoque() {
+    if (fd_pv >= 0) {
+      try {
+        write_header_pv();
+      } catch (...) {
+      }
+    }
+    close_pv();
+  }
+
+  void swap(mapped_monoque &other) {
+    std::swap(fd_pv, other.fd_pv);
+    std::swap(size_pv, other.size_pv);
+    std::swap(packed_pv, other.packed_pv);
+    std::swap(head_pv, other.head_pv);
+    std::swap(data_pv, other.data_pv);
+    std::swap(offset_pv, other.offset_pv);
+  }
+
+  inline T &operator[](size_t at) {
+    using namespace std;
+    size_t i1, i2;
+    tie(i1, i2) = layout::index(at);
+    return data_pv[i1][i2];
+  }
+
+  inline T const &operator[](size_t at) const {
+    using namespace std;
+    size_t i1, i2;
+    tie(i1, i2) = layout::index(at);
+    return data_pv[i1][i2];
+  }
+
+  reference at(size_type pos) {
+    if (!(pos < size()))
+      throw std::out_of_range("mapped_monoque::at");
+    return (*this)[pos];
+  }
+
+  const_reference at(size_type pos) const {
+    if (!(pos < size()))
+      throw std::out_of_range("mapped_monoque::at");
+    return (*this)[pos];
+  }
+
+  reference front() { return (*this)[0]; }
+  const_reference front() const { return (*this)[0]; }
+  reference back() { return (*this)[size_pv - 1]; }
+  const_reference back() const { return (*this)[size_pv - 1]; }
+
+  size_type size() const { return size_pv; }
+  bool empty() const { return size_pv == 0; }
+
+  void push_back(T const &t) {
+    using namespace std;
+    size_t i1, i2;
+    tie(i1, i2) = layout::index(size_pv);
+    T *blk = data_pv[i1];
+    if (blk == nullptr)
+      blk = extend_pv(i1);
+    blk[i2] = t;
+    size_pv++;
+  }
+
+  template <typename... Ts> void emplace_back(Ts &&... ts) { push_back(T(std::forward<Ts>(ts)...)); }
+
+  void pop_back() {
+    assert(size_pv >= 1);
+    size_pv--;
+  }
+
+  // Forgets every element. The file keeps its blocks and they are reused by later appends.
+  void clear() { size_pv = 0; }
+
+  // Calls f(T *data, size_t n) once per contiguous run covering [0, size()).
+  template <typename F> void for_each_segment(F &&f) {
+    for (size_t k = 0, e = layout::segment_count(size_pv); k < e; k++)
+      f(data_pv[k], std::min(layout::segment_capacity(k), size_pv - layout::segment_begin(k)));
+  }
+
+  template <typename F> void for_each_segment(F &&f) const {
+    for (size_t k = 0, e = layout::segment_count(size_pv); k < e; k++)
+      f(static_cast<T const *>(data_pv[k]), std::min(layout::segment_capacity(k), size_pv - layout::segment_begin(k)));
+  }
+
+  // Writes the size to the header and flushes every mapped block to the file.
+  void sync() {
+    if (msync(head_pv, align_pv, MS_SYNC) != 0)
+      fail_pv("mapped_monoque: msync");
+    for (size_t k = packed_pv; k < data_pv.size(); k++)
+      if (data_pv[k] != nullptr && msync(data_pv[k], block_bytes_pv(k), MS_SYNC) != 0)
+        fail_pv("mapped_monoque: msync");
+    write_header_pv();
+    if (fsync(fd_pv) != 0)
+      fail_pv("mapped_monoque: fsync");
+  }
+};
+} // namespace rpnx
+
+#endif
@@ -0,0 +1,393 @@
+/*
+Monodeque Data Structure
+
+Copyright (c) 2017, 2018 Ryan P. Nicholl <exaeta@protonmail.com> http://rpnx.net/
+ -- Please let me know if you find this structure useful, thanks!
+
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef RPNX_MONODEQUE_HH
+#define RPNX_MONODEQUE_HH
+
+#include "monoque.hh"
+#include <array>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+/*
+  Double ended monoque: worst-case O(1) push/pop at both ends and worst-case
+  O(1) indexing, without ever relocating an element.
+
+  Elements live at signed positions [begin_pv, end_pv). Position p >= 0 is
+  stored in the back table at monoque index p, and position p < 0 in a
+  mirrored front table at monoque index ~p (= -p - 1). Both tables use the
+  monoque_layout block sizes, so operator[] is one sign select plus the usual
+  clz math.
+
+  A pop that leaves a block frees the block beyond it, keeping the one it
+  just left as a spare so traffic back and forth across a boundary does not
+  reallocate. A deque that becomes empty re-centres on position 0 and frees
+  everything but the smallest blocks; shrink_to_fit() releases every block
+  outside the live range.
+
+  Positions only move, they are never renumbered while elements are live,
+  since that would relocate them. A deque used as a sliding window that
+  never empties therefore drifts into larger and larger blocks: its memory
+  is about the size of the block its live range has reached, which grows
+  with the total traffic rather than with size().
+ */
+
+namespace rpnx {
+template <typename T, typename Allocator = std::allocator<T>> class monodeque : private Allocator {
+public:
+  using value_type = T;
+  using allocator_type = Allocator;
+  using size_type = size_t;
+  using difference_type = ssize_t;
+  using reference = T &;
+  using const_reference = T const &;
+  using pointer = typename std::allocator_traits<Allocator>::pointer;
+  using const_pointer = typename std::allocator_traits<Allocator>::const_pointer;
+  using layout = monoque_layout;
+
+private:
+  using traits_pv = std::allocator_traits<Allocator>;
+  using table_pv = std::array<pointer, sizeof(T *) * 8>;
+
+  // tables_pv[0] holds positions >= 0, tables_pv[1] positions < 0.
+  std::array<table_pv, 2> tables_pv;
+  ssize_t begin_pv;
+  ssize_t end_pv;
+
+  inline T *locate_pv(ssize_t p) const {
+    using namespace std;
+    size_t neg = size_t(p) >> (sizeof(size_t) * 8 - 1);
+    size_t q = size_t(p) ^ (size_t(0) - neg);
+    size_t i1, i2;
+    tie(i1, i2) = layout::index(q);
+    return tables_pv[neg][i1] + i2;
+  }
+
+  T *prepare_pv(ssize_t p) {
+    using namespace std;
+    size_t neg = p < 0;
+    size_t q = neg ? ~size_t(p) : size_t(p);
+    size_t i1, i2;
+    tie(i1, i2) = layout::index(q);
+    pointer &blk = tables_pv[neg][i1];
+    if (blk == nullptr)
+      blk = traits_pv::allocate(*this, layout::segment_capacity(i1));
+    return blk + i2;
+  }
+
+  void free_blocks_pv(bool keep_live) {
+    for (size_t neg = 0; neg < 2; neg++) {
+      for (size_t k = 0; k < tables_pv[neg].size(); k++) {
+        pointer &blk = tables_pv[neg][k];
+        if (blk == nullptr)
+          continue;
+        if (keep_live) {
+          // Block k covers q in [segment_begin(k), segment_begin(k) + segment_capacity(k)).
+          ssize_t lo = neg ? -ssize_t(layout::segment_begin(k) + layout::segment_capacity(k)) : ssize_t(layout::segment_begin(k));
+          ssize_t hi = lo + ssize_t(layout::segment_capacity(k));
+          if (lo < end_pv && begin_pv < hi)
+            continue;
+        }
+        traits_pv::deallocate(*this, blk, layout::segment_capacity(k));
+        blk = nullptr;
+      }
+    }
+  }
+
+  // Table and block holding position p, and the positions [lo, hi) that block covers.
+  struct block_ref_pv {
+    size_t neg, k;
+    ssize_t lo, hi;
+  };
+
+  static block_ref_pv block_of_pv(ssize_t p) {
+    size_t neg = p < 0;
+    size_t k = layout::index1(neg ? ~size_t(p) : size_t(p));
+    ssize_t lo = neg ? -ssize_t(layout::segment_begin(k) + layout::segment_capacity(k)) : ssize_t(layout::segment_begin(k));
+    return block_ref_pv{neg, k, lo, lo + ssize_t(layout::segment_capacity(k))};
+  }
+
+  // Frees the block holding position p if it is allocated and holds no live position.
+  void release_pv(ssize_t p) {
+    block_ref_pv b = block_of_pv(p);
+    pointer &blk = tables_pv[b.neg][b.k];
+    if (blk != nullptr && (b.hi <= begin_pv || end_pv <= b.lo)) {
+      traits_pv::deallocate(*this, blk, layout::segment_capacity(b.k));
+      blk = nullptr;
+    }
+  }
+
+  // An emptied deque starts over at position 0; only the first two blocks on each side are kept.
+  void recentre_pv() {
+    bool far = begin_pv < -ssize_t(2 * layout::base_size) || begin_pv > ssize_t(2 * layout::base_size);
+    begin_pv = end_pv = 0;
+    if (far)
+      for (size_t neg = 0; neg < 2; neg++)
+        for (size_t k = 2; k < tables_pv[neg].size(); k++)
+          if (tables_pv[neg][k] != nullptr) {
+            traits_pv::deallocate(*this, tables_pv[neg][k], layout::segment_capacity(k));
+            tables_pv[neg][k] = nullptr;
+          }
+  }
+
+  template <typename M, typename U> class basic_iterator {
+    friend class monodeque<T, Allocator>;
+    template <typename, typename> friend class basic_iterator;
+
+    M *m;
+    size_type i;
+
+    basic_iterator(M *m, size_type i) : m(m), i(i) {}
+
+  public:
+    using value_type = T;
+    using difference_type = ssize_t;
+    using pointer = U *;
+    using reference = U &;
+    using iterator_category = std::random_access_iterator_tag;
+
+    basic_iterator() : m(nullptr), i(0) {}
+    template <typename M2, typename U2> basic_iterator(basic_iterator<M2, U2> const &o) : m(o.m), i(o.i) {}
+
+    reference operator*() const { return (*m)[i]; }
+    pointer operator->() const { return &(*m)[i]; }
+    reference operator[](difference_type n) const { return (*m)[i + n]; }
+
+    basic_iterator &operator++() {
+      i++;
+      return *this;
+    }
+
+    basic_iterator operator++(int) {
+      basic_iterator copy = *this;
+      i++;
+      return copy;
+    }
+
+    basic_iterator &operator--() {
+      i--;
+      return *this;
+    }
+
+    basic_iterator operator--(int) {
+      basic_iterator copy = *this;
+      i--;
+      return copy;
+    }
+
+    basic_iterator &operator+=(difference_type n) {
+      i += n;
+      return *this;
+    }
+
+    basic_iterator &operator-=(difference_type n) {
+      i -= n;
+      return *this;
+    }
+
+    basic_iterator operator+(difference_type n) const { return basic_iterator(m, i + n); }
+    basic_iterator operator-(difference_type n) const { return basic_iterator(m, i - n); }
+    difference_type operator-(basic_iterator const &o) const { return i - o.i; }
+
+    bool operator==(basic_iterator const &o) const { return m == o.m && i == o.i; }
+    bool operator!=(basic_iterator const &o) const { return m != o.m || i != o.i; }
+    bool operator<(basic_iterator const &o) const { return i < o.i; }
+    bool operator<=(basic_iterator const &o) const { return i <= o.i; }
+    bool operator>(basic_iterator const &o) const { return i > o.i; }
+    bool operator>=(basic_iterator const &o) const { return i >= o.i; }
+  };
+
+public:
+  using iterator = basic_iterator<monodeque<T, Allocator>, T>;
+  using const_iterator = basic_iterator<monodeque<T, Allocator> const, T const>;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  monodeque() : monodeque(Allocator()) {}
+
+  explicit monodeque(allocator_type const &alloc) : Allocator(alloc), begin_pv(0), end_pv(0) {
+    for (auto &tbl : tables_pv)
+      for (auto &x : tbl)
+        x = nullptr;
+  }
+
+  template <typename It, typename = typename std::iterator_traits<It>::iterator_category>
+  monodeque(It first, It last, allocator_type const &alloc = Allocator()) : monodeque(alloc) {
+    for (; first != last; ++first)
+      emplace_back(*first);
+  }
+
+  monodeque(std::initializer_list<T> il, allocator_type const &alloc = Allocator()) : monodeque(il.begin(), il.end(), alloc) {}
+
+  monodeque(monodeque const &other) : monodeque(other.begin(), other.end(), traits_pv::select_on_container_copy_construction(other.get_allocator())) {}
+
+  monodeque(monodeque &&other) : monodeque(other.get_allocator()) { swap_pv<false>(other); }
+
+  monodeque &operator=(monodeque const &other) {
+    constexpr bool propagate = traits_pv::propagate_on_container_copy_assignment::value;
+    if (this != &other) {
+      monodeque copy(other.begin(), other.end(), propagate ? other.get_allocator() : get_allocator());
+      swap_pv<propagate>(copy);
+    }
+    return *this;
+  }
+
+  // Takes other's blocks when the allocator propagates or compares equal; otherwise moves the elements one by one.
+  monodeque &operator=(monodeque &&other) {
+    constexpr bool propagate = traits_pv::propagate_on_container_move_assignment::value;
+    if (propagate || traits_pv::is_always_equal::value || get_allocator() == other.get_allocator()) {
+      swap_pv<propagate>(other);
+    } else {
+      monodeque moved(std::make_move_iterator(other.begin()), std::make_move_iterator(other.end()), get_allocator());
+      swap_pv<false>(moved);
+    }
+    return *this;
+  }
+
+  ~monodeque() {
+    if (!std::is_trivially_destructible<T>::value)
+      while (!empty())
+        pop_back();
+    free_blocks_pv(false);
+  }
+
+  inline T &operator[](size_type at) { return *locate_pv(begin_pv + ssize_t(at)); }
+  inline T const &operator[](size_type at) const { return *locate_pv(begin_pv + ssize_t(at)); }
+
+  reference at(size_type pos) {
+    if (!(pos < size()))
+      throw std::out_of_range("monodeque::at");
+    return (*this)[pos];
+  }
+
+  const_reference at(size_type pos) const {
+    if (!(pos < size()))
+      throw std::out_of_range("monodeque::at");
+    return (*this)[pos];
+  }
+
+  reference front() { return *locate_pv(begin_pv); }
+  const_reference front() const { return *locate_pv(begin_pv); }
+  reference back() { return *locate_pv(end_pv - 1); }
+  const_reference back() const { return *locate_pv(end_pv - 1); }
+
+  size_type size() const { return size_type(end_pv - begin_pv); }
+  bool empty() const { return end_pv == begin_pv; }
+  allocator_type const &get_allocator() const { return *this; }
+
+  template <typename... Ts> void emplace_back(Ts &&... ts) {
+    traits_pv::construct(*this, prepare_pv(end_pv), std::forward<Ts>(ts)...);
+    end_pv++;
+  }
+
+  template <typename... Ts> void emplace_front(Ts &&... ts) {
+    traits_pv::construct(*this, prepare_pv(begin_pv - 1), std::forward<Ts>(ts)...);
+    begin_pv--;
+  }
+
+  void push_back(T const &t) { emplace_back(t); }
+  void push_back(T &&t) { emplace_back(std::move(t)); }
+  void push_front(T const &t) { emplace_front(t); }
+  void push_front(T &&t) { emplace_front(std::move(t)); }
+
+  void pop_back() {
+    assert(!empty());
+    traits_pv::destroy(*this, locate_pv(end_pv - 1));
+    end_pv--;
+    if (rpnx_unlikely(empty())) {
+      recentre_pv();
+      return;
+    }
+    // Leaving a block: the one just left stays as a spare, the one past it goes.
+    block_ref_pv b = block_of_pv(end_pv);
+    if (rpnx_unlikely(end_pv == b.lo))
+      release_pv(b.hi);
+  }
+
+  void pop_front() {
+    assert(!empty());
+    traits_pv::destroy(*this, locate_pv(begin_pv));
+    begin_pv++;
+    if (rpnx_unlikely(empty())) {
+      recentre_pv();
+      return;
+    }
+    block_ref_pv b = block_of_pv(begin_pv - 1);
+    if (rpnx_unlikely(begin_pv == b.hi))
+      release_pv(b.lo - 1);
+  }
+
+  // Destroys every element and re-centres on position 0, keeping the smallest blocks for reuse.
+  void clear() {
+    if (!std::is_trivially_destructible<T>::value)
+      while (!empty())
+        pop_back();
+    recentre_pv();
+  }
+
+  void shrink_to_fit() {
+    if (empty())
+      begin_pv = end_pv = 0;
+    free_blocks_pv(true);
+  }
+
+  // Like monoque::swap: allocators are exchanged only if they propagate on swap, and must otherwise compare equal.
+  void swap(monodeque &other) {
+    assert(traits_pv::propagate_on_container_swap::value || get_allocator() == other.get_allocator());
+    swap_pv<traits_pv::propagate_on_container_swap::value>(other);
+  }
+
+  friend void swap(monodeque &a, monodeque &b) { a.swap(b); }
+
+private:
+  template <bool SwapAllocators> void swap_pv(monodeque &other) {
+    if constexpr (SwapAllocators) {
+      using std::swap;
+      swap(static_cast<allocator_type &>(*this), static_cast<allocator_type &>(other));
+    }
+    std::swap(tables_pv, other.tables_pv);
+    std::swap(begin_pv, other.begin_pv);
+    std::swap(end_pv, other.end_pv);
+  }
+
+public:
+
+  iterator begin() { return iterator(this, 0); }
+  iterator end() { return iterator(this, size()); }
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, size()); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+  reverse_iterator rbegin() { return reverse_iterator(end()); }
+  reverse_iterator rend() { return reverse_iterator(begin()); }
+  const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+  const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+};
+} // namespace rpnx
+
+#endif
@@ -27,16 +27,26 @@ SOFTWARE.
 #ifndef RPNX_MONOQUE_HH
 #define RPNX_MONOQUE_HH
 
+#include <algorithm>
 #include <array>
 #include <assert.h>
 #include <atomic>
 #include <inttypes.h>
 #include <iterator>
 #include <limits.h>
+#include <memory>
 #include <stdint.h>
 #include <string.h>
 #include <sys/types.h>
 #include <tuple>
+#include <type_traits>
+#include <vector>
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#endif
+#if defined(__LZCNT__) && defined(__BMI2__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
 /*
   Like vector, but non-contiguous and has worst-case O(1) push_back and
   worst-case O(1) indexing.
@@ -59,138 +69,544 @@ SOFTWARE.
 #endif
 
 namespace rpnx {
-template <typename T, typename Allocator = std::allocator<T>> class monoque : private Allocator {
-public:
-  using value_type = T;
-  using allocator_type = Allocator;
-  using const_reference = typename allocator_type::const_reference;
-  using pointer = typename allocator_type::pointer;
-  using const_pointer = typename allocator_type::const_pointer;
-  using size_type = typename allocator_type::size_type;
-  using reference = typename Allocator::reference;
+/*
+  Index backends: the bit arithmetic the layout below is built on. Each one provides
 
-  static_assert(std::is_same<size_type, size_t>::value, "currently unsupported");
-  static_assert(std::is_same<reference, T &>::value, "wut");
+    log2(n)         position of the highest set bit of n, n != 0
+    low_bits(n, b)  n with every bit from b up cleared, b < 64
 
-private:
-  size_t size_pv;
-  std::array<pointer, sizeof(T *) * 8> data_pv;
+  and they only differ in how they get there:
 
-  static inline size_t bfill(size_t n) {
-    n |= n >> 1;
-    n |= n >> 2;
-    n |= n >> 4;
-    n |= n >> 8;
-    n |= n >> 16;
-    if (sizeof(size_t) > 4)
-      n |= n >> 32;
-    return n;
-  }
+    monoque_index_clz     __builtin_clz, with bsr and shift-loop fallbacks (the default)
+    monoque_index_bmi2    lzcnt and bzhi; needs -mlzcnt -mbmi2, otherwise it is monoque_index_clz
+    monoque_index_table   a 256 entry table for small indices, clz above
+    monoque_index_32      32 bit clz with no width checks; every index must be below 2^32
 
-private:
-  static inline size_t index1_pv(size_t n) {
+  index_benchmark.cc times them against each other; pick one per target with
+  the Index parameter of monoque.
+ */
+struct monoque_index_clz {
+  static inline size_t log2(size_t n) {
 #if defined(__GNUC__) && SIZE_MAX == 18446744073709551615ull && ULONG_LONG_MAX == SIZE_MAX
-    return 63 - __builtin_clzll(n | 1);
+    return 63 - __builtin_clzll(n);
 #elif defined(__GNUC__) && SIZE_MAX == 4294967295ull && UINT_MAX == SIZE_MAX
-    return 31 - __builtin_clz(n | 1);
+    return 31 - __builtin_clz(n);
 #elif defined(__x86_64__)
 #warning Fallback to x64 assembly
-    if (n == 0)
-      return 0;
-    else {
-      size_t i;
-      asm("bsrq %1,%0\n" : "=r"(i) : "r"(n));
-      return i;
-    }
+    size_t i;
+    asm("bsrq %1,%0\n" : "=r"(i) : "r"(n));
+    return i;
 #else
 #warning Very slow generic implementation
-    if (n == 0)
-      return 0;
     size_t n2 = 0;
-    while (n != 1) { n >>=1; n2 ++; }
+    while (n != 1) {
+      n >>= 1;
+      n2++;
+    }
     return n2;
-   size_t a = bfill(n);
-   a = a & ~(a >> 1);
-   size_t i = 0;
-   if (a & 0b10101010101010101010101010101010) i |= 1;
-   if (a & 0b11001100110011001100110011001100) i |= 2;
-   if (a & 0b11110000111100001111000011110000) i |= 4;
-   if (a & 0b11111111000000001111111100000000) i |= 8;
-   if (a & 0b11111111111111110000000000000000) i |= 16;
-#if SIZE_MAX > 4294967295ull
-   if (a & 0b1111111111111111111111111111111100000000000000000000000000000000ull) i |= 32;
-#endif
-    return i;
 #endif
   }
 
-  static inline size_t sizeat_pv(size_t at) {
-#if defined(__GNUC__) && SIZE_MAX == 18446744073709551615ull && ULONG_LONG_MAX == SIZE_MAX
-    static_assert(sizeof(unsigned long long) == 8, "This is a bug.");
+  static inline size_t low_bits(size_t n, size_t b) { return n & ((size_t(1) << b) - 1); }
+};
 
-    return 1 << (64 - __builtin_clzll((at >> 1) | 1));
-#elif defined(__GNUC__) && SIZE_MAX == 4294967295ull && UINT_MAX == SIZE_MAX
-    return 1 << (32 - __builtin_clz((at >> 1) | 1));
-#elif defined(__x86_64__)
-#warning Fell back to inline assembly?
-    if (at == 0)
-      return 2;
-    size_t i;
-    asm("bsrq %1,%0\n" : "=r"(i) : "r"(at));
-    return size_t(1) << i;
+#if defined(__LZCNT__) && defined(__BMI2__) && defined(__x86_64__)
+struct monoque_index_bmi2 {
+  static inline size_t log2(size_t n) { return 63 - _lzcnt_u64(n); }
+  static inline size_t low_bits(size_t n, size_t b) { return _bzhi_u64(n, unsigned(b)); }
+};
 #else
-#warning Generic implementation may be slow.
-    if (at == 0)
-      return 2;
-    else
-      return bfill(at >> 1) + 1;
+struct monoque_index_bmi2 : monoque_index_clz {};
 #endif
+
+struct monoque_log2_table_pv {
+  uint8_t log2[256];
+  constexpr monoque_log2_table_pv() : log2() {
+    for (size_t i = 2; i != 256; i++)
+      log2[i] = uint8_t(log2[i / 2] + 1);
   }
+};
 
-  static inline size_t index2_pv(size_t n) {
-#if defined(__GNUC__) && SIZE_MAX == 18446744073709551615ull && ULONG_LONG_MAX == SIZE_MAX
-    static_assert(sizeof(unsigned long long) == 8, "This is a bug.");
-    return n & ((1 << (63 - __builtin_clzll(n | 2))) - 1);
-#elif defined(__GNUC__) && SIZE_MAX == 4294967295ull && UINT_MAX == SIZE_MAX
-    static_assert(sizeof(unsigned long long) == 8, "This is a bug.");
-    return n & ((1 << (31 - __builtin_clz(n | 2))) - 1);
-#elif defined(__x86_64__)
-    if (n <= 1)
-      return n & 1;
-    else {
-      size_t i;
-      asm("bsrq %1,%0\n" : "=r"(i) : "r"(n));
-      return n ^ (size_t(1) << i);
-    }
+struct monoque_index_table {
+  static constexpr monoque_log2_table_pv table{};
+
+  static inline size_t log2(size_t n) { return rpnx_likely(n < 256) ? table.log2[n] : monoque_index_clz::log2(n); }
+  static inline size_t low_bits(size_t n, size_t b) { return monoque_index_clz::low_bits(n, b); }
+};
+
+struct monoque_index_32 {
+  static inline size_t log2(size_t n) {
+    assert(n <= UINT32_MAX);
+#if defined(__GNUC__)
+    return 31 - __builtin_clz(uint32_t(n));
 #else
-#warning Generic implementation used.
-    return n & (bfill(n) >> 1);
+    return monoque_index_clz::log2(n);
 #endif
   }
+  static inline size_t low_bits(size_t n, size_t b) { return uint32_t(n) & ((uint32_t(1) << b) - 1); }
+};
+
+/*
+  Index arithmetic for the monoque block layout, shared with the containers
+  built on it. Block 0 holds BaseSize elements and every block k > 0 holds
+  BaseSize << (k - 1), so block k > 0 starts at index BaseSize << (k - 1) and
+  element i lives in block index1(i) at offset index2(i). BaseSize must be a
+  power of two; with the default of 2 the blocks hold 2, 2, 4, 8, ... elements.
+ */
+template <size_t BaseSize, typename Index = monoque_index_clz> class basic_monoque_layout {
+  static_assert(BaseSize >= 2 && (BaseSize & (BaseSize - 1)) == 0, "BaseSize must be a power of two");
+
+  static constexpr size_t log2_constexpr(size_t n) { return n <= 1 ? 0 : 1 + log2_constexpr(n >> 1); }
+
+public:
+  using index_backend = Index;
+  static constexpr size_t base_size = BaseSize;
+  static constexpr size_t base_log2 = log2_constexpr(BaseSize);
+  static constexpr size_t max_segments = sizeof(size_t) * 8 - base_log2 + 1;
+
+  // Position of the highest set bit; n must not be 0.
+  static inline size_t log2(size_t n) { return Index::log2(n); }
+
+  static inline size_t index1(size_t n) { return Index::log2(n | (BaseSize - 1)) + 1 - base_log2; }
+
+  static inline size_t index2(size_t n) { return Index::low_bits(n, Index::log2(n | BaseSize)); }
+
+  static inline std::tuple<size_t, size_t> index(size_t at) { return std::tuple<size_t, size_t>{index1(at), index2(at)}; }
+
+  // First index stored in block k, and the number of elements block k holds.
+  static inline size_t segment_begin(size_t k) { return k == 0 ? 0 : BaseSize << (k - 1); }
+  static inline size_t segment_capacity(size_t k) { return k == 0 ? BaseSize : BaseSize << (k - 1); }
+
+  // Capacity of the block holding index at.
+  static inline size_t sizeat(size_t at) { return segment_capacity(index1(at)); }
+
+  // Number of blocks that hold elements of [0, n).
+  static inline size_t segment_count(size_t n) { return n == 0 ? 0 : index1(n - 1) + 1; }
+};
+
+using monoque_layout = basic_monoque_layout<2>;
+
+/*
+  In-object storage for block 0 when a monoque is created with InlineBase.
+  The empty primary template costs nothing thanks to the empty base optimization.
+ */
+template <typename T, size_t N, bool Inline> class monoque_inline_storage {
+protected:
+  T *inline_block_pv() { return nullptr; }
+};
+
+template <typename T, size_t N> class monoque_inline_storage<T, N, true> {
+  typename std::aligned_storage<sizeof(T) * N, alignof(T)>::type storage_pv;
+
+protected:
+  T *inline_block_pv() { return reinterpret_cast<T *>(&storage_pv); }
+};
+
+/*
+  Counters reported by monoque::stats(). segments, bytes_reserved and bytes_used are read off the
+  container itself; the rest come from its Stats policy and stay zero with no_monoque_stats.
+  segments counts allocated blocks only, while bytes_reserved includes an InlineBase block, so
+  bytes_reserved - bytes_used is always the slack.
+ */
+struct monoque_stats_snapshot {
+  uint64_t segments = 0;
+  uint64_t bytes_reserved = 0;
+  uint64_t bytes_used = 0;
+  uint64_t segment_allocations = 0;
+  uint64_t segment_frees = 0;
+  uint64_t peak_segments = 0;
+  uint64_t peak_bytes_reserved = 0;
+  uint64_t allocate_ns = 0;
+  uint64_t max_allocate_ns = 0;
+  // Sampled element accesses by block index.
+  std::array<uint64_t, sizeof(void *) * 8> access_samples = {};
+};
+
+/*
+  The Stats policy of a monoque sees every block allocation and free and every operator[] access:
+
+    template <typename F> auto on_block_allocate(size_t k, size_t bytes, F &&allocate) -> decltype(allocate());
+    void on_block_free(size_t k, size_t bytes);
+    void on_access(size_t k) const;
+    void fill(monoque_stats_snapshot &s) const;
+
+  no_monoque_stats does nothing and, as an empty base, adds no bytes. See monoque_stats.hh for a counting policy.
+ */
+struct no_monoque_stats {
+  template <typename F> auto on_block_allocate(size_t, size_t, F &&allocate) -> decltype(allocate()) { return allocate(); }
+  void on_block_free(size_t, size_t) {}
+  void on_access(size_t) const {}
+  void fill(monoque_stats_snapshot &) const {}
+};
+
+// Iterators that know their monoque and index; the algorithms using them are at the end of this file.
+namespace segmented {
+template <typename It, typename = void> struct is_segmented_iterator : std::false_type {};
+template <typename It>
+struct is_segmented_iterator<It, std::void_t<decltype(std::declval<It const &>().container()->segment_count()), decltype(std::declval<It const &>().index())>>
+    : std::true_type {};
+
+/*
+  Calls f(pointer p, size_t n) for each run of [first, last) that lies in one block. f returns how
+  many of the n elements it consumed; fewer than n stops the walk. Returns the iterator after the
+  last consumed element.
+ */
+template <typename It, typename F> It for_each_run_pv(It first, It last, F &&f) {
+  using layout = typename std::remove_pointer<decltype(first.container())>::type::layout;
+  while (first != last) {
+    size_t k, o;
+    std::tie(k, o) = layout::index(first.index());
+    size_t n = std::min(layout::segment_capacity(k) - o, size_t(last - first));
+    size_t used = f(&*first, n);
+    first += used;
+    if (used != n)
+      break;
+  }
+  return first;
+}
+} // namespace segmented
+
+template <typename T, typename Allocator = std::allocator<T>, size_t BaseSize = 2, bool InlineBase = false, typename Stats = no_monoque_stats,
+          typename Index = monoque_index_clz>
+class monoque : private Allocator, private monoque_inline_storage<T, BaseSize, InlineBase>, private Stats {
+public:
+  using value_type = T;
+  using allocator_type = Allocator;
+  using reference = T &;
+  using const_reference = T const &;
+  using pointer = typename std::allocator_traits<Allocator>::pointer;
+  using const_pointer = typename std::allocator_traits<Allocator>::const_pointer;
+  using size_type = typename std::allocator_traits<Allocator>::size_type;
+  using layout = basic_monoque_layout<BaseSize, Index>;
+  static constexpr bool inline_base = InlineBase;
+
+  static_assert(std::is_same<size_type, size_t>::value, "currently unsupported");
+  static_assert(std::is_same<pointer, T *>::value, "fancy pointers are not supported");
+
+private:
+  using traits_pv = std::allocator_traits<Allocator>;
 
-  static inline std::tuple<size_t, size_t> index_pv(size_t at) { return std::tuple<size_t, size_t>{index1_pv(at), index2_pv(at)}; }
+  size_t size_pv;
+  std::array<pointer, sizeof(T *) * 8> data_pv;
+
+  // Ahead-of-time growth, see set_preallocation(). push_back only compares size_pv against prepare_at_pv.
+  size_t prepare_at_pv;
+  size_t prefault_block_pv;
+  size_t prefaulted_pv;
+  float preallocate_fill_pv;
+
+  template <typename Self, typename F> static void for_each_segment_pv(Self &self, size_t first, size_t last, F &f) {
+    using namespace std;
+    if (first >= last)
+      return;
+
+    size_t k, off;
+    tie(k, off) = layout::index(first);
+    while (first != last) {
+      size_t n = std::min(layout::segment_capacity(k) - off, last - first);
+      f(self.data_pv[k] + off, n);
+      first += n;
+      k++;
+      off = 0;
+    }
+  }
 
   void check_cleanup() {}
 
+  Allocator &alloc_pv() { return *this; }
+
+  // The inline blocks cannot change owner, so their elements are exchanged instead.
+  void swap_inline_pv(monoque &other) {
+    using std::swap;
+    size_t a = std::min(size_pv, BaseSize), b = std::min(other.size_pv, BaseSize);
+    T *mine = data_pv[0], *theirs = other.data_pv[0];
+    for (size_t i = 0; i < std::min(a, b); i++)
+      swap(mine[i], theirs[i]);
+    if (a < b)
+      std::swap(mine, theirs);
+    for (size_t i = std::min(a, b); i < std::max(a, b); i++) {
+      traits_pv::construct(alloc_pv(), theirs + i, std::move(mine[i]));
+      traits_pv::destroy(alloc_pv(), mine + i);
+    }
+  }
+
+  pointer allocate_block_pv(size_t k) {
+    size_t n = layout::segment_capacity(k);
+    return Stats::on_block_allocate(k, n * sizeof(T), [&] { return traits_pv::allocate(alloc_pv(), n); });
+  }
+
+  void free_block_pv(size_t k) {
+    Stats::on_block_free(k, layout::segment_capacity(k) * sizeof(T));
+    traits_pv::deallocate(alloc_pv(), data_pv[k], layout::segment_capacity(k));
+  }
+
+  pointer ensure_segment_pv(size_t k) {
+    if (data_pv[k] == nullptr)
+      data_pv[k] = allocate_block_pv(k);
+    return data_pv[k];
+  }
+
+  // Allocates every segment needed to hold n elements.
+  void reserve_segments_pv(size_t n) {
+    for (size_t k = 0, e = layout::segment_count(n); k < e; k++)
+      ensure_segment_pv(k);
+  }
+
+  /*
+    Called from push_back once size_pv reaches prepare_at_pv. Past the fill threshold of the current block it
+    allocates the next block, then writes one byte per 4 KiB page of it over the remaining pushes of the
+    current block, a few pages per push, so the page faults are paid before the block is reached.
+   */
+  void preallocate_step_pv() {
+    size_t k = layout::index1(size_pv);
+    size_t begin = layout::segment_begin(k), cap = layout::segment_capacity(k);
+    // Capped at the last slot of the block, so fill = 1 still allocates before the block runs out.
+    size_t trigger = begin + std::min(cap - 1, size_t(cap * preallocate_fill_pv));
+    if (k + 1 >= layout::max_segments || preallocate_fill_pv <= 0) {
+      prepare_at_pv = SIZE_MAX;
+      return;
+    }
+    if (size_pv < trigger) {
+      prepare_at_pv = trigger;
+      return;
+    }
+
+    size_t next = k + 1;
+    size_t bytes = layout::segment_capacity(next) * sizeof(T);
+    if (data_pv[next] == nullptr) {
+      data_pv[next] = allocate_block_pv(next);
+      prefault_block_pv = next;
+      prefaulted_pv = 0;
+    }
+    if (prefault_block_pv == next && prefaulted_pv < bytes) {
+      size_t pages = (bytes - prefaulted_pv + 4095) / 4096;
+      size_t pushes = begin + cap - size_pv;
+      size_t end = std::min(bytes, prefaulted_pv + (pages + pushes - 1) / pushes * 4096);
+      volatile char *raw = reinterpret_cast<char *>(&*data_pv[next]);
+      for (; prefaulted_pv < end; prefaulted_pv += 4096)
+        raw[prefaulted_pv] = 0;
+    }
+    prepare_at_pv = (prefault_block_pv == next && prefaulted_pv < bytes) ? size_pv + 1 : begin + cap;
+  }
+
+  // Called when size_pv drops, so the next push re-derives the preallocation threshold for the smaller size.
+  void rearm_preallocation_pv() {
+    if (preallocate_fill_pv > 0)
+      prepare_at_pv = std::min(prepare_at_pv, size_pv);
+  }
+
+  // Whether Allocator brings its own construct(); std::allocator's (before C++20) is plain placement new.
+  template <typename A, typename = void> struct custom_construct_pv : std::false_type {};
+  template <typename A>
+  struct custom_construct_pv<A, decltype(void(std::declval<A &>().construct(std::declval<T *>())))>
+      : std::integral_constant<bool, !std::is_same<A, std::allocator<T>>::value> {};
+
+  // Default-initialization may bypass the allocator only when the allocator would have nothing to add.
+  static constexpr bool default_init_pv = std::is_trivially_default_constructible<T>::value && !custom_construct_pv<Allocator>::value;
+
+  // Sources we can memcpy from: pointers and vector iterators over T.
+  template <typename It> static constexpr bool memcpy_source_pv() {
+    return std::is_trivially_copyable<T>::value &&
+           (std::is_same<It, T *>::value || std::is_same<It, T const *>::value || std::is_same<It, typename std::vector<T>::iterator>::value ||
+            std::is_same<It, typename std::vector<T>::const_iterator>::value);
+  }
+
+  // Constructs len elements at p from first, growing size_pv as it goes so a throwing copy leaves a valid monoque.
+  template <typename It> It copy_segment_pv(It first, T *p, size_t len, std::true_type) {
+    memcpy(p, &*first, len * sizeof(T));
+    size_pv += len;
+    return first + len;
+  }
+
+  template <typename It> It copy_segment_pv(It first, T *p, size_t len, std::false_type) {
+    for (size_t i = 0; i != len; i++, ++first) {
+      traits_pv::construct(alloc_pv(), p + i, *first);
+      size_pv++;
+    }
+    return first;
+  }
+
+  template <typename It> void append_pv(It first, It last, std::input_iterator_tag) {
+    using namespace std;
+    while (first != last) {
+      size_t k, off;
+      tie(k, off) = layout::index(size_pv);
+      T *p = ensure_segment_pv(k);
+      for (size_t i = off, cap = layout::segment_capacity(k); i != cap && first != last; i++, ++first) {
+        traits_pv::construct(alloc_pv(), p + i, *first);
+        size_pv++;
+      }
+    }
+  }
+
+  template <typename It> void append_pv(It first, It last, std::forward_iterator_tag) {
+    size_t n = std::distance(first, last);
+    reserve_segments_pv(size_pv + n);
+    if constexpr (segmented::is_segmented_iterator<It>::value) {
+      // A range of some monoque: append it one source block at a time, each run taking the pointer path.
+      segmented::for_each_run_pv(first, last, [&](auto *p, size_t len) {
+        append(p, p + len);
+        return len;
+      });
+    } else {
+      auto copy = [&](T *p, size_t len) { first = copy_segment_pv(first, p, len, std::integral_constant<bool, memcpy_source_pv<It>()>()); };
+      for_each_segment_pv(*this, size_pv, size_pv + n, copy);
+    }
+  }
+
+  void append_pv(monoque const &other) {
+    reserve_segments_pv(size_pv + other.size());
+    other.for_each_segment([&](T const *p, size_t len) { append(p, p + len); });
+  }
+
+  // Destroys [n, size_pv) block by block.
+  void destroy_tail_pv(size_t n) {
+    if (!std::is_trivially_destructible<T>::value)
+      for_each_segment(n, size_pv, [this](T *p, size_t len) {
+        for (size_t i = 0; i != len; i++)
+          traits_pv::destroy(alloc_pv(), p + i);
+      });
+    size_pv = n;
+    rearm_preallocation_pv();
+  }
+
+  static void move_run_pv(T *dst, T *src, size_t n, std::true_type) { memmove(dst, src, n * sizeof(T)); }
+  static void move_run_pv(T *dst, T *src, size_t n, std::false_type) {
+    if (dst < src)
+      std::move(src, src + n, dst);
+    else
+      std::move_backward(src, src + n, dst + n);
+  }
+
+  /*
+    Move-assigns the live elements [src, src + n) onto the live elements [dst, dst + n), in runs
+    that stay inside one block on both sides, front to back when moving down and back to front
+    when moving up, so the ranges may overlap.
+   */
+  void move_within_pv(size_t dst, size_t src, size_t n) {
+    using namespace std;
+    using trivial = integral_constant<bool, is_trivially_copyable<T>::value>;
+    if (dst < src) {
+      while (n != 0) {
+        size_t sk, so, dk, dof;
+        tie(sk, so) = layout::index(src);
+        tie(dk, dof) = layout::index(dst);
+        size_t len = min(n, min(layout::segment_capacity(sk) - so, layout::segment_capacity(dk) - dof));
+        move_run_pv(data_pv[dk] + dof, data_pv[sk] + so, len, trivial());
+        src += len, dst += len, n -= len;
+      }
+    } else if (dst > src) {
+      while (n != 0) {
+        size_t sk, so, dk, dof;
+        tie(sk, so) = layout::index(src + n - 1);
+        tie(dk, dof) = layout::index(dst + n - 1);
+        size_t len = min(n, min(so, dof) + 1);
+        move_run_pv(data_pv[dk] + dof + 1 - len, data_pv[sk] + so + 1 - len, len, trivial());
+        n -= len;
+      }
+    }
+  }
+
+  // Yields *v over and over, as a forward iterator for insert_pv.
+  struct repeat_pv {
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = ptrdiff_t;
+    using pointer = T const *;
+    using reference = T const &;
+
+    T const *v;
+    size_t n;
+
+    T const &operator*() const { return *v; }
+    repeat_pv &operator++() {
+      n++;
+      return *this;
+    }
+  };
+
+  template <typename It> void insert_range_pv(size_t pos, It first, It last, std::input_iterator_tag) {
+    monoque tmp(first, last, get_allocator());
+    insert_pv(pos, std::make_move_iterator(tmp.begin()), tmp.size());
+  }
+
+  template <typename It> void insert_range_pv(size_t pos, It first, It last, std::forward_iterator_tag) {
+    insert_pv(pos, first, size_t(std::distance(first, last)));
+  }
+
+  // Makes room for k elements at pos and fills it from first, a forward range of k elements.
+  template <typename It> void insert_pv(size_t pos, It first, size_t k) {
+    size_t old = size_pv, after = old - pos;
+    if (k <= after) {
+      for_each_segment(old - k, old, [this](T *p, size_t len) {
+        for (size_t i = 0; i != len; i++)
+          emplace_back(std::move(p[i]));
+      });
+      move_within_pv(pos + k, pos, after - k);
+      for_each_segment(pos, pos + k, [&](T *p, size_t len) {
+        for (size_t i = 0; i != len; i++, ++first)
+          p[i] = *first;
+      });
+    } else {
+      It mid = std::next(first, after);
+      for (It it = mid; size_pv != old + k - after; ++it)
+        emplace_back(*it);
+      for_each_segment(pos, old, [this](T *p, size_t len) {
+        for (size_t i = 0; i != len; i++)
+          emplace_back(std::move(p[i]));
+      });
+      for_each_segment(pos, old, [&](T *p, size_t len) {
+        for (size_t i = 0; i != len; i++, ++first)
+          p[i] = *first;
+      });
+    }
+  }
+
 public:
+  /*
+    Besides its index, an iterator caches a pointer to its element and the bounds of the block that
+    holds it, so ++, -- and * are pointer operations until a block boundary is crossed. Steps that
+    leave the block drop the cache and the next dereference looks the block up again.
+   */
   class const_iterator {
   public:
     // template <typename T, Allocator>
-    friend class monoque<T, Allocator>;
-    friend class monoque<T, Allocator>::iterator;
-
-  protected:
-    monoque<T, Allocator> const *m;
-    size_type i;
-
-  public:
-    const_iterator() : m(nullptr), i(0) {}
+    friend class monoque;
+    friend class monoque::iterator;
 
-    using value_type = monoque<T, Allocator>::value_type;
+    using value_type = typename monoque::value_type;
     using difference_type = ssize_t;
     using pointer = T const *;
     using reference = T const &;
     using category = std::random_access_iterator_tag;
+    using iterator_category = std::random_access_iterator_tag;
+
+  protected:
+    monoque const *m;
+    size_type i;
+    mutable T const *p_pv;
+    mutable T const *begin_pv;
+    mutable T const *end_pv;
+
+    void refresh_pv() const {
+      using namespace std;
+      size_t k, o;
+      tie(k, o) = layout::index(i);
+      begin_pv = m->data_pv[k];
+      end_pv = begin_pv + layout::segment_capacity(k);
+      p_pv = begin_pv + o;
+    }
+
+    void advance_pv(difference_type n) {
+      i += n;
+      if (p_pv != nullptr) {
+        difference_type o = (p_pv - begin_pv) + n;
+        p_pv = (o >= 0 && o < end_pv - begin_pv) ? begin_pv + o : nullptr;
+      }
+    }
+
+  public:
+    const_iterator() : m(nullptr), i(0), p_pv(nullptr), begin_pv(nullptr), end_pv(nullptr) {}
 
     const_iterator(const const_iterator &) = default;
     const_iterator(const_iterator &&) = default;
@@ -198,49 +614,59 @@ public:
     const_iterator &operator=(const_iterator const &) = default;
     const_iterator &operator=(const_iterator &&) = default;
 
-    value_type const &operator*() const { return (*m)[i]; }
+    value_type const &operator*() const {
+      if (rpnx_unlikely(p_pv == nullptr))
+        refresh_pv();
+      return *p_pv;
+    }
+
+    pointer operator->() const { return &**this; }
 
     const_iterator &operator++() {
       i++;
+      if (p_pv != nullptr && ++p_pv == end_pv)
+        p_pv = nullptr;
       return *this;
     }
 
     const_iterator operator++(int) {
       const_iterator copy = *this;
-      i++;
+      ++*this;
       return copy;
     }
 
     const_iterator &operator--() {
       i--;
+      if (p_pv != nullptr)
+        p_pv = p_pv == begin_pv ? nullptr : p_pv - 1;
       return *this;
     }
 
     const_iterator operator--(int) {
       const_iterator copy = *this;
-      i--;
+      --*this;
       return copy;
     }
 
     const_iterator &operator+=(difference_type n) {
-      i += n;
+      advance_pv(n);
       return *this;
     }
 
     const_iterator &operator-=(difference_type n) {
-      i -= n;
+      advance_pv(-n);
       return *this;
     }
 
     const_iterator operator+(difference_type n) const {
       const_iterator copy = *this;
-      copy.i += n;
+      copy.advance_pv(n);
       return copy;
     }
 
     const_iterator operator-(difference_type n) const {
       const_iterator copy = *this;
-      copy.i -= n;
+      copy.advance_pv(-n);
       return copy;
     }
 
@@ -256,14 +682,18 @@ public:
 
     bool operator>=(const_iterator const &o) const { return i >= o.i; }
 
-    value_type const &operator[](difference_type n) const { return (*m)[i + n]; }
+    value_type const &operator[](difference_type n) const { return *(*this + n); }
 
     difference_type operator-(const_iterator const &other) const { return i - other.i; }
+
+    // The container and position, for algorithms that walk the blocks directly; see rpnx::copy.
+    monoque const *container() const { return m; }
+    size_type index() const { return i; }
   };
 
   class iterator : public const_iterator {
   public:
-    using value_type = typename monoque<T, Allocator>::value_type;
+    using value_type = typename monoque::value_type;
     using difference_type = ssize_t;
     using pointer = T *;
     using reference = T &;
@@ -300,24 +730,24 @@ public:
     }
 
     iterator &operator+=(ssize_t n) {
-      this->i += n;
+      this->advance_pv(n);
       return *this;
     }
 
     iterator &operator-=(ssize_t n) {
-      this->i -= n;
+      this->advance_pv(-n);
       return *this;
     }
 
     iterator operator+(difference_type n) const {
       iterator copy = *this;
-      copy.i += n;
+      copy.advance_pv(n);
       return copy;
     }
 
     iterator operator-(difference_type n) const {
       iterator copy = *this;
-      copy.i -= n;
+      copy.advance_pv(-n);
       return copy;
     }
 
@@ -329,66 +759,142 @@ public:
   using reverse_iterator = std::reverse_iterator<iterator>;
   using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
-  monoque() : Allocator(std::allocator<T>()), size_pv(0) {
+  /*
+    A contiguous run of elements inside one data_pv block. The monoque is the
+    concatenation of segment(0), segment(1), ... segment(segment_count() - 1).
+   */
+  template <typename U> class basic_segment {
+    U *data_pv;
+    size_type size_pv;
+
+  public:
+    basic_segment() : data_pv(nullptr), size_pv(0) {}
+    basic_segment(U *data, size_type size) : data_pv(data), size_pv(size) {}
+
+    U *data() const { return data_pv; }
+    size_type size() const { return size_pv; }
+    bool empty() const { return size_pv == 0; }
+    U *begin() const { return data_pv; }
+    U *end() const { return data_pv + size_pv; }
+    U &operator[](size_type n) const { return data_pv[n]; }
+  };
+
+  using segment_type = basic_segment<T>;
+  using const_segment_type = basic_segment<T const>;
+
+  template <typename U, typename M> class basic_segment_range {
+    M *m;
+
+  public:
+    class iterator {
+      M *m;
+      size_type k;
+
+    public:
+      using value_type = basic_segment<U>;
+      using difference_type = ssize_t;
+      using pointer = void;
+      using reference = basic_segment<U>;
+      using iterator_category = std::input_iterator_tag;
+
+      iterator(M *m, size_type k) : m(m), k(k) {}
+
+      basic_segment<U> operator*() const { return m->segment(k); }
+
+      iterator &operator++() {
+        k++;
+        return *this;
+      }
+
+      iterator operator++(int) {
+        iterator copy = *this;
+        k++;
+        return copy;
+      }
+
+      bool operator==(iterator const &o) const { return k == o.k; }
+      bool operator!=(iterator const &o) const { return k != o.k; }
+    };
+
+    explicit basic_segment_range(M *m) : m(m) {}
+
+    iterator begin() const { return iterator(m, 0); }
+    iterator end() const { return iterator(m, m->segment_count()); }
+    size_type size() const { return m->segment_count(); }
+  };
+
+  using segment_range = basic_segment_range<T, monoque>;
+  using const_segment_range = basic_segment_range<T const, monoque const>;
+
+  monoque() : Allocator(), size_pv(0), prepare_at_pv(SIZE_MAX), prefault_block_pv(SIZE_MAX), prefaulted_pv(0), preallocate_fill_pv(0) {
     for (auto &x : data_pv)
       x = nullptr;
+    if (InlineBase)
+      data_pv[0] = this->inline_block_pv();
   }
 
-  explicit monoque(allocator_type const &alloc) : allocator_type(alloc), size_pv(0) {
+  explicit monoque(allocator_type const &alloc)
+      : allocator_type(alloc), size_pv(0), prepare_at_pv(SIZE_MAX), prefault_block_pv(SIZE_MAX), prefaulted_pv(0), preallocate_fill_pv(0) {
 
     for (auto &a : data_pv)
       a = nullptr;
+    if (InlineBase)
+      data_pv[0] = this->inline_block_pv();
   }
 
-  explicit monoque(size_type n, allocator_type const &alloc = std::allocator<T>()) : monoque(alloc) { resize(n); }
+  explicit monoque(size_type n, allocator_type const &alloc = allocator_type()) : monoque(alloc) { resize(n); }
 
-  explicit monoque(size_type n, value_type const &val, allocator_type const &alloc = std::allocator<T>()) : monoque(alloc) {
+  explicit monoque(size_type n, value_type const &val, allocator_type const &alloc = allocator_type()) : monoque(alloc) { append_n(n, val); }
 
-    for (size_type i = 0; i != n; i++) {
-      push_back(val);
-    }
-  }
-
-  monoque(std::initializer_list<value_type> il, allocator_type const &alloc = std::allocator<T>()) : monoque(alloc) { assign(il.begin(), il.end()); }
+  monoque(std::initializer_list<value_type> il, allocator_type const &alloc = allocator_type()) : monoque(alloc) { assign(il.begin(), il.end()); }
 
-  template <typename It> monoque(It begin, It end, allocator_type const &alloc = std::allocator<T>()) : monoque(alloc) {
-    for (auto i = begin; i != end; i++) {
-      push_back(*i);
-    }
+  template <typename It, typename = typename std::iterator_traits<It>::iterator_category>
+  monoque(It begin, It end, allocator_type const &alloc = allocator_type()) : monoque(alloc) {
+    append(begin, end);
   }
 
-  monoque(monoque<T, Allocator> const &other) : monoque(other.get_allocator()) {
-    using namespace std;
-    for (auto const &x : other)
-      push_back(x);
-  }
+  monoque(monoque const &other) : monoque(traits_pv::select_on_container_copy_construction(other.get_allocator())) { append_pv(other); }
+
+  monoque(monoque const &other, allocator_type const &alloc) : monoque(alloc) { append_pv(other); }
 
-  monoque(monoque<T, Allocator> &&other) : monoque(other.get_allocator()) { swap(other); }
+  monoque(monoque &&other) : monoque(other.get_allocator()) { swap_pv<false>(other); }
 
-  monoque<T, Allocator> &operator=(monoque<T, Allocator> const &other) {
+  monoque(monoque &&other, allocator_type const &alloc) : monoque(alloc) {
+    if (alloc == other.get_allocator())
+      swap_pv<false>(other);
+    else
+      append(std::make_move_iterator(other.begin()), std::make_move_iterator(other.end()));
+  }
 
-    monoque<T, Allocator> copy(get_allocator());
-    copy.assign(other.begin(), other.end());
-    swap(copy);
+  monoque &operator=(monoque const &other) {
+    constexpr bool propagate = traits_pv::propagate_on_container_copy_assignment::value;
+    if (this != &other) {
+      monoque copy(propagate ? other.get_allocator() : get_allocator());
+      copy.append_pv(other);
+      swap_pv<propagate>(copy);
+    }
     return *this;
   }
 
-  monoque<T, Allocator> &operator=(monoque<T, Allocator> &&other) {
-    swap(other);
+  // Takes other's blocks when the allocator propagates or compares equal; otherwise moves the elements one by one.
+  monoque &operator=(monoque &&other) {
+    constexpr bool propagate = traits_pv::propagate_on_container_move_assignment::value;
+    if (propagate || traits_pv::is_always_equal::value || get_allocator() == other.get_allocator()) {
+      swap_pv<propagate>(other);
+    } else {
+      monoque moved(get_allocator());
+      moved.append(std::make_move_iterator(other.begin()), std::make_move_iterator(other.end()));
+      swap_pv<false>(moved);
+    }
     return *this;
   }
 
   ~monoque() {
-    if (!std::is_trivially_destructible<T>::value)
-      while (size() != 0)
-        pop_back();
+    destroy_tail_pv(0);
 
-    for (size_t i = 0; i < sizeof(void *) * 8; i++) {
-      size_t sz = 1 << i;
-      if (sz == 1)
-        sz = 2;
+    for (size_t i = InlineBase ? 1 : 0; i < sizeof(void *) * 8; i++) {
       if (data_pv[i] != nullptr)
-        Allocator::deallocate(data_pv[i], sz);
+        free_block_pv(i);
     }
   }
 
@@ -400,7 +906,8 @@ public:
     size_t index1;
     size_t index2;
 
-    tie(index1, index2) = index_pv(at);
+    tie(index1, index2) = layout::index(at);
+    Stats::on_access(index1);
 
     return data_pv[index1][index2];
   }
@@ -420,17 +927,58 @@ public:
     size_t index1;
     size_t index2;
 
-    tie(index1, index2) = index_pv(at);
+    tie(index1, index2) = layout::index(at);
+    Stats::on_access(index1);
 
     return data_pv[index1][index2];
   }
 
   size_t size() const { return size_pv; }
 
+  // Number of data_pv blocks that hold elements of [0, size()).
+  size_type segment_count() const { return layout::segment_count(size_pv); }
+
+  segment_type segment(size_type k) { return segment_type(data_pv[k], std::min(layout::segment_capacity(k), size_pv - layout::segment_begin(k))); }
+
+  const_segment_type segment(size_type k) const {
+    return const_segment_type(data_pv[k], std::min(layout::segment_capacity(k), size_pv - layout::segment_begin(k)));
+  }
+
+  /*
+    The elements from index i to the end of its block, or of the monoque, for batches of neighbouring
+    accesses: run_at(i)[j] is (*this)[i + j] for every j < run_at(i).size(), but the index is only
+    decomposed once. Requires i < size().
+   */
+  segment_type run_at(size_type i) {
+    using namespace std;
+    size_t k, o;
+    tie(k, o) = layout::index(i);
+    Stats::on_access(k);
+    return segment_type(data_pv[k] + o, std::min(layout::segment_capacity(k) - o, size_pv - i));
+  }
+
+  const_segment_type run_at(size_type i) const {
+    using namespace std;
+    size_t k, o;
+    tie(k, o) = layout::index(i);
+    Stats::on_access(k);
+    return const_segment_type(data_pv[k] + o, std::min(layout::segment_capacity(k) - o, size_pv - i));
+  }
+
+  segment_range segments() { return segment_range(this); }
+  const_segment_range segments() const { return const_segment_range(this); }
+
+  // Calls f(T *data, size_t n) once per contiguous run, in order, covering [first, last).
+  template <typename F> void for_each_segment(size_type first, size_type last, F &&f) { for_each_segment_pv(*this, first, last, f); }
+  template <typename F> void for_each_segment(size_type first, size_type last, F &&f) const { for_each_segment_pv(*this, first, last, f); }
+
+  template <typename F> void for_each_segment(F &&f) { for_each_segment_pv(*this, 0, size_pv, f); }
+  template <typename F> void for_each_segment(F &&f) const { for_each_segment_pv(*this, 0, size_pv, f); }
+
   allocator_type const &get_allocator() const { return *this; }
 
   template <typename It> inline void assign(It begin, It end) {
-    monoque<T, Allocator> obj(begin, end, get_allocator());
+    monoque obj(begin, end, get_allocator());
     swap(obj);
     return;
   }
@@ -439,9 +987,41 @@ public:
 
   void assign(size_type count, const T &value) {
     clear();
-    for (size_t i = 0; i < count; i++) {
-      push_back(value);
-    }
+    append_n(count, value);
+  }
+
+  // Appends [first, last) one whole segment at a time. Forward ranges allocate every segment they need up front.
+  template <typename It> void append(It first, It last) { append_pv(first, last, typename std::iterator_traits<It>::iterator_category()); }
+
+  /*
+    Grows the monoque by n elements without constructing them itself: fill(T *data, size_t len) is called
+    once per contiguous run, in order, and must construct all len elements before returning. If fill
+    throws, that run is not added.
+   */
+  template <typename F> void append_with(size_type n, F &&fill) {
+    reserve_segments_pv(size_pv + n);
+    auto run = [&](T *p, size_t len) {
+      fill(p, len);
+      size_pv += len;
+    };
+    for_each_segment_pv(*this, size_pv, size_pv + n, run);
+  }
+
+  // Appends n copies of val.
+  void append_n(size_type n, value_type const &val) {
+    reserve_segments_pv(size_pv + n);
+    auto fill = [&](T *p, size_t len) {
+      if (std::is_trivially_copyable<T>::value) {
+        std::uninitialized_fill_n(p, len, val);
+        size_pv += len;
+      } else {
+        for (size_t i = 0; i != len; i++) {
+          traits_pv::construct(alloc_pv(), p + i, val);
+          size_pv++;
+        }
+      }
+    };
+    for_each_segment_pv(*this, size_pv, size_pv + n, fill);
   }
 
   reference at(size_type pos) {
@@ -456,18 +1036,192 @@ public:
     return this->operator[](pos);
   }
 
-  void clear() {
-    monoque<T, Allocator> obj(get_allocator());
-    swap(obj);
+  // Allocates every block needed to hold n elements, so pushes up to n never allocate.
+  void reserve(size_type n) { reserve_segments_pv(n); }
+
+  // Elements that fit before the next push_back has to allocate.
+  size_type capacity() const {
+    size_t k = 0;
+    while (k < layout::max_segments && data_pv[k] != nullptr)
+      k++;
+    return k == 0 ? 0 : layout::segment_begin(k - 1) + layout::segment_capacity(k - 1);
+  }
+
+  // Current footprint plus whatever the Stats policy has recorded.
+  monoque_stats_snapshot stats() const {
+    monoque_stats_snapshot s;
+    for (size_t k = InlineBase ? 1 : 0; k < layout::max_segments; k++) {
+      if (data_pv[k] != nullptr) {
+        s.segments++;
+        s.bytes_reserved += layout::segment_capacity(k) * sizeof(T);
+      }
+    }
+    // bytes_used counts elements in the inline block too, so it is reserved as well.
+    if (InlineBase)
+      s.bytes_reserved += layout::segment_capacity(0) * sizeof(T);
+    s.bytes_used = size_pv * sizeof(T);
+    Stats::fill(s);
+    return s;
+  }
+
+  /*
+    Opt-in ahead-of-time growth for latency sensitive appends. Once the current block is more than fill
+    (0 < fill <= 1) full, the next block is allocated and its pages are touched a few at a time by the
+    following pushes, so no single push_back pays for a large allocation or a burst of page faults.
+    fill = 1 waits for the last slot of the block, so one push pays for all of it. fill = 0 turns it off again.
+   */
+  void set_preallocation(float fill) {
+    preallocate_fill_pv = fill;
+    prefault_block_pv = SIZE_MAX;
+    prepare_at_pv = fill > 0 ? size_pv : SIZE_MAX;
+  }
+
+  // Destroys every element but keeps the blocks, so refilling does not go back to the allocator. See shink_to_fit().
+  void clear() { destroy_tail_pv(0); }
+
+  /*
+    insert and erase shift the tail of the container block run by block: memmove for trivially
+    copyable T, std::move / std::move_backward otherwise. Iterators at or after pos are invalidated
+    in the sense that they now refer to different elements; no element changes address.
+   */
+  iterator insert(const_iterator pos, T const &v) { return insert(pos, size_type(1), v); }
+
+  iterator insert(const_iterator pos, T &&v) {
+    size_t at = pos.i;
+    insert_pv(at, std::make_move_iterator(&v), 1);
+    return begin() + at;
+  }
+
+  iterator insert(const_iterator pos, size_type count, T const &v) {
+    size_t at = pos.i;
+    if (count != 0) {
+      // v may live in this container, and the shift would move it.
+      T copy(v);
+      insert_pv(at, repeat_pv{&copy, 0}, count);
+    }
+    return begin() + at;
+  }
+
+  template <typename It, typename = typename std::iterator_traits<It>::iterator_category> iterator insert(const_iterator pos, It first, It last) {
+    size_t at = pos.i;
+    insert_range_pv(at, first, last, typename std::iterator_traits<It>::iterator_category());
+    return begin() + at;
+  }
+
+  iterator insert(const_iterator pos, std::initializer_list<T> il) { return insert(pos, il.begin(), il.end()); }
+
+  template <typename... Ts> iterator emplace(const_iterator pos, Ts &&... ts) {
+    T v(std::forward<Ts>(ts)...);
+    return insert(pos, std::move(v));
+  }
+
+  iterator erase(const_iterator pos) { return erase(pos, pos + 1); }
+
+  iterator erase(const_iterator first, const_iterator last) {
+    size_t a = first.i, b = last.i;
+    if (a != b) {
+      move_within_pv(a, b, size_pv - b);
+      destroy_tail_pv(size_pv - (b - a));
+    }
+    return begin() + a;
+  }
+
+  /*
+    Removes every element for which pred is true in a single pass, keeping the order of the rest,
+    and returns how many were removed. The read and write positions each walk the blocks with a
+    plain pointer.
+   */
+  template <typename Pred> size_type erase_if(Pred pred) {
+    size_t w = 0;
+    T *wp = nullptr, *wend = nullptr;
+    for_each_segment([&](T *p, size_t len) {
+      for (size_t i = 0; i != len; i++) {
+        if (pred(static_cast<T const &>(p[i])))
+          continue;
+        if (wp == wend) {
+          size_t k = layout::index1(w);
+          wp = data_pv[k] + (w - layout::segment_begin(k));
+          wend = data_pv[k] + layout::segment_capacity(k);
+        }
+        if (wp != p + i)
+          *wp = std::move(p[i]);
+        wp++;
+        w++;
+      }
+    });
+    size_t removed = size_pv - w;
+    destroy_tail_pv(w);
+    return removed;
+  }
+
+  template <typename Pred> friend size_type erase_if(monoque &m, Pred pred) { return m.erase_if(pred); }
+
+  template <typename U> friend size_type erase(monoque &m, U const &value) {
+    return m.erase_if([&](T const &x) { return x == value; });
   }
 
   bool empty() const { return size() == 0; }
 
-  inline void resize(size_type n) {
-    while (size() > n)
-      pop_back();
-    while (size() < n)
-      push_back(value_type());
+  // Value-initializes the new elements block by block; trivial types are zeroed a whole run at a time.
+  void resize(size_type n) {
+    if (n <= size_pv) {
+      destroy_tail_pv(n);
+      return;
+    }
+    reserve_segments_pv(n);
+    auto fill = [&](T *p, size_t len) {
+      if (std::is_trivial<T>::value) {
+        std::uninitialized_value_construct_n(p, len);
+        size_pv += len;
+      } else {
+        for (size_t i = 0; i != len; i++) {
+          traits_pv::construct(alloc_pv(), p + i);
+          size_pv++;
+        }
+      }
+    };
+    for_each_segment_pv(*this, size_pv, n, fill);
+  }
+
+  void resize(size_type n, value_type const &val) {
+    if (n <= size_pv)
+      destroy_tail_pv(n);
+    else
+      append_n(n - size_pv, val);
+  }
+
+  /*
+    Like resize(n), but the new elements are default-initialized: for trivial types the blocks are
+    only allocated and the new elements are left indeterminate, for the caller to overwrite. When
+    T is not trivial, or the allocator has a construct() of its own, each element goes through
+    that construct(), so allocator-aware elements get its resource.
+   */
+  void resize_for_overwrite(size_type n) {
+    if (n <= size_pv) {
+      destroy_tail_pv(n);
+      return;
+    }
+    reserve_segments_pv(n);
+    if (default_init_pv && std::is_trivially_destructible<T>::value) {
+      size_pv = n;
+      return;
+    }
+    auto fill = [&](T *p, size_t len) {
+      for (size_t i = 0; i != len; i++) {
+        if (default_init_pv)
+          ::new (static_cast<void *>(p + i)) T;
+        else
+          traits_pv::construct(alloc_pv(), p + i);
+        size_pv++;
+      }
+    };
+    for_each_segment_pv(*this, size_pv, n, fill);
+  }
+
+  // Destroys the elements from n on; n must not exceed size().
+  void truncate(size_type n) {
+    assert(n <= size_pv);
+    destroy_tail_pv(n);
   }
 
   inline void push_back(T t) {
@@ -475,54 +1229,91 @@ public:
 
     size_t i1, i2, s;
     s = size_pv;
-    tie(i1, i2) = index_pv(s);
+    tie(i1, i2) = layout::index(s);
 
+    if (rpnx_unlikely(s >= prepare_at_pv))
+      preallocate_step_pv();
     if (data_pv[i1] == nullptr) {
-      data_pv[i1] = Allocator::allocate(sizeat_pv(s));
+      data_pv[i1] = allocate_block_pv(i1);
     }
-    this->Allocator::construct(data_pv[i1] + i2, std::move(t));
+    traits_pv::construct(alloc_pv(), data_pv[i1] + i2, std::move(t));
     size_pv++;
   }
 
   void pop_back() {
+    using namespace std;
     assert(size() >= 1);
-    Allocator::destroy(&this->operator[](size_pv - 1));
+    size_t i1, i2;
+    tie(i1, i2) = layout::index(size_pv - 1);
+    traits_pv::destroy(alloc_pv(), data_pv[i1] + i2);
     size_pv--;
+    rearm_preallocation_pv();
+  }
+
+  // Removes the last n elements.
+  void pop_back(size_type n) {
+    assert(n <= size_pv);
+    destroy_tail_pv(size_pv - n);
+  }
+
+  // Allocators are exchanged only if they propagate on swap; otherwise they must compare equal.
+  void swap(monoque &other) {
+    assert(traits_pv::propagate_on_container_swap::value || get_allocator() == other.get_allocator());
+    swap_pv<traits_pv::propagate_on_container_swap::value>(other);
   }
 
-  void swap(monoque<T, Allocator> &other) {
-    std::swap(static_cast<allocator_type &>(*this), static_cast<allocator_type &>(other));
+private:
+  template <bool SwapAllocators> void swap_pv(monoque &other) {
+    if constexpr (SwapAllocators) {
+      using std::swap;
+      swap(alloc_pv(), other.alloc_pv());
+    }
+    if (InlineBase)
+      swap_inline_pv(other);
     std::swap(data_pv, other.data_pv);
+    if (InlineBase)
+      std::swap(data_pv[0], other.data_pv[0]);
     std::swap(size_pv, other.size_pv);
+    std::swap(prepare_at_pv, other.prepare_at_pv);
+    std::swap(prefault_block_pv, other.prefault_block_pv);
+    std::swap(prefaulted_pv, other.prefaulted_pv);
+    std::swap(preallocate_fill_pv, other.preallocate_fill_pv);
+    std::swap(static_cast<Stats &>(*this), static_cast<Stats &>(other));
   }
 
+public:
   template <typename... Ts> void emplace_back(Ts &&... ts) {
     using namespace std;
 
     size_t i1, i2, s;
     s = size_pv;
-    tie(i1, i2) = index_pv(s);
+    tie(i1, i2) = layout::index(s);
 
+    if (rpnx_unlikely(s >= prepare_at_pv))
+      preallocate_step_pv();
     if (data_pv[i1] == nullptr) {
-      data_pv[i1] = this->Allocator::allocate(sizeat_pv(s));
+      data_pv[i1] = allocate_block_pv(i1);
     }
-    this->Allocator::construct(data_pv[i1] + i2, std::forward<Ts>(ts)...);
+    traits_pv::construct(alloc_pv(), data_pv[i1] + i2, std::forward<Ts>(ts)...);
     size_pv++;
   }
 
-  friend void swap(rpnx::monoque<T, Allocator> &a, rpnx::monoque<T, Allocator> &b) { a.swap(b); }
+  friend void swap(monoque &a, monoque &b) { a.swap(b); }
 
   void shink_to_fit() {
     size_t mindex = 0;
     if (size_pv != 0)
-      mindex = index1_pv(size_pv - 1) + 1;
-    for (size_t i = mindex; i < sizeof(T *) * 8; i++) {
+      mindex = layout::index1(size_pv - 1) + 1;
+    for (size_t i = std::max(mindex, size_t(InlineBase)); i < sizeof(T *) * 8; i++) {
       if (data_pv[i] != nullptr) {
-        delete[](char *) data_pv[i];
+        free_block_pv(i);
         data_pv[i] = nullptr;
+        if (prefault_block_pv == i)
+          prefault_block_pv = SIZE_MAX;
       } else
         break;
     }
+    rearm_preallocation_pv();
   }
 
   inline iterator begin() {
@@ -557,6 +1348,67 @@ public:
   const_iterator begin() const { return cbegin(); }
 };
 
+#if __has_include(<memory_resource>)
+namespace pmr {
+/*
+  A monoque whose blocks come from a std::pmr::memory_resource, such as a per-request
+  std::pmr::monotonic_buffer_resource that releases every block at once. Elements that are
+  themselves allocator aware, like std::pmr::string, get the same resource.
+ */
+template <typename T> using monoque = rpnx::monoque<T, std::pmr::polymorphic_allocator<T>>;
+} // namespace pmr
+#endif
+
+/*
+  Segmented versions of a few standard algorithms. Given monoque iterators they call the standard
+  algorithm once per block, on plain pointers, so the inner loops are the same as for a vector.
+  Any other iterator goes straight to the std:: algorithm.
+
+    auto it = rpnx::segmented::find(m.begin(), m.end(), 42);
+    rpnx::segmented::copy(m.cbegin(), m.cend(), std::back_inserter(v));
+
+  They live in their own namespace so that unqualified calls to copy or find on monoque iterators
+  keep finding std:: only.
+ */
+namespace segmented {
+template <typename It, typename Out> Out copy(It first, It last, Out out) {
+  if constexpr (is_segmented_iterator<It>::value) {
+    for_each_run_pv(first, last, [&](auto *p, size_t n) {
+      out = std::copy(p, p + n, out);
+      return n;
+    });
+    return out;
+  } else
+    return std::copy(first, last, out);
+}
+
+template <typename It, typename Pred> It find_if(It first, It last, Pred pred) {
+  if constexpr (is_segmented_iterator<It>::value)
+    return for_each_run_pv(first, last, [&](auto *p, size_t n) { return size_t(std::find_if(p, p + n, pred) - p); });
+  else
+    return std::find_if(first, last, pred);
+}
+
+template <typename It, typename V> It find(It first, It last, V const &value) {
+  if constexpr (is_segmented_iterator<It>::value)
+    return for_each_run_pv(first, last, [&](auto *p, size_t n) { return size_t(std::find(p, p + n, value) - p); });
+  else
+    return std::find(first, last, value);
+}
+
+template <typename It, typename F> F for_each(It first, It last, F f) {
+  if constexpr (is_segmented_iterator<It>::value) {
+    for_each_run_pv(first, last, [&](auto *p, size_t n) {
+      for (size_t i = 0; i != n; i++)
+        f(p[i]);
+      return n;
+    });
+    return f;
+  } else
+    return std::for_each(first, last, f);
+}
+} // namespace segmented
+
 } // namespace rpnx
 
 #endif
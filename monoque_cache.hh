@@ -0,0 +1,220 @@
+/*
+Monoque Segment Cache
+
+Copyright (c) 2017, 2018 Ryan P. Nicholl <exaeta@protonmail.com> http://rpnx.net/
+ -- Please let me know if you find this structure useful, thanks!
+
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef RPNX_MONOQUE_CACHE_HH
+#define RPNX_MONOQUE_CACHE_HH
+
+#include "monoque.hh"
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+
+/*
+  Recycling of freed monoque blocks.
+
+  monoque::clear() already keeps its own blocks. When monoques are destroyed
+  and rebuilt instead, a segment_cache keeps the freed blocks, keyed by byte
+  size, and hands them back to the next allocation of the same size. Since
+  monoque blocks only come in a few power-of-two sizes, steady state
+  create/fill/destroy cycles stop reaching malloc and stop faulting in fresh
+  pages. The cache holds at most byte_limit bytes; anything beyond that is
+  freed immediately.
+
+  Freed blocks are chained through their own first bytes into one list per
+  size, and the lists sit in a fixed table, so deallocate never allocates and
+  cannot throw: it is called from destructors, clear() and pop_back. Blocks
+  smaller than a pointer, or of a size beyond the table's distinct sizes, are
+  simply freed.
+
+  caching_allocator<T> routes a container's allocations through a cache:
+
+    rpnx::segment_cache scratch(64 << 20);                              // one per instance / request
+    rpnx::monoque<int, rpnx::caching_allocator<int>> a(rpnx::caching_allocator<int>(scratch));
+    rpnx::monoque<int, rpnx::caching_allocator<int>> b;                 // process wide shared cache
+    rpnx::caching_allocator<int> tl(rpnx::thread_segment_cache());      // per thread cache
+
+  A cache passed by reference must outlive every container allocating from it.
+  thread_segment_cache() returns shared ownership instead: the allocator keeps
+  the cache alive, so a container may outlive (or move away from) the thread
+  that created it.
+ */
+
+namespace rpnx {
+class segment_cache {
+  struct free_block_pv {
+    free_block_pv *next;
+  };
+
+  // One list per distinct block size; size 0 marks an unused slot.
+  struct bucket_pv {
+    size_t bytes = 0;
+    free_block_pv *head = nullptr;
+  };
+
+  std::mutex m_pv;
+  std::array<bucket_pv, 128> free_pv;
+  size_t limit_pv;
+  size_t cached_pv;
+  size_t hits_pv;
+  size_t misses_pv;
+
+public:
+  explicit segment_cache(size_t byte_limit = size_t(256) << 20) : limit_pv(byte_limit), cached_pv(0), hits_pv(0), misses_pv(0) {}
+
+  segment_cache(segment_cache const &) = delete;
+  segment_cache &operator=(segment_cache const &) = delete;
+
+  ~segment_cache() { trim(); }
+
+  void *allocate(size_t bytes) {
+    {
+      std::lock_guard<std::mutex> lock(m_pv);
+      for (auto &bucket : free_pv) {
+        if (bucket.bytes == 0)
+          break;
+        if (bucket.bytes == bytes && bucket.head != nullptr) {
+          free_block_pv *p = bucket.head;
+          bucket.head = p->next;
+          cached_pv -= bytes;
+          hits_pv++;
+          return p;
+        }
+      }
+      misses_pv++;
+    }
+    return ::operator new(bytes);
+  }
+
+  void deallocate(void *p, size_t bytes) noexcept {
+    if (bytes >= sizeof(free_block_pv)) {
+      std::lock_guard<std::mutex> lock(m_pv);
+      if (cached_pv + bytes <= limit_pv) {
+        for (auto &bucket : free_pv) {
+          if (bucket.bytes != bytes && bucket.bytes != 0)
+            continue;
+          bucket.bytes = bytes;
+          bucket.head = ::new (p) free_block_pv{bucket.head};
+          cached_pv += bytes;
+          return;
+        }
+      }
+    }
+    ::operator delete(p);
+  }
+
+  // Frees every cached block.
+  void trim() {
+    std::lock_guard<std::mutex> lock(m_pv);
+    for (auto &bucket : free_pv)
+      while (bucket.head != nullptr) {
+        free_block_pv *p = bucket.head;
+        bucket.head = p->next;
+        ::operator delete(p);
+      }
+    cached_pv = 0;
+  }
+
+  void set_byte_limit(size_t byte_limit) {
+    std::lock_guard<std::mutex> lock(m_pv);
+    limit_pv = byte_limit;
+  }
+
+  size_t byte_limit() {
+    std::lock_guard<std::mutex> lock(m_pv);
+    return limit_pv;
+  }
+
+  size_t cached_bytes() {
+    std::lock_guard<std::mutex> lock(m_pv);
+    return cached_pv;
+  }
+
+  // Allocations served from the cache, and allocations that had to go to operator new.
+  size_t hits() {
+    std::lock_guard<std::mutex> lock(m_pv);
+    return hits_pv;
+  }
+
+  size_t misses() {
+    std::lock_guard<std::mutex> lock(m_pv);
+    return misses_pv;
+  }
+};
+
+inline segment_cache &shared_segment_cache() {
+  static segment_cache cache;
+  return cache;
+}
+
+// Shared ownership, so allocators bound to it stay valid after the thread exits.
+inline std::shared_ptr<segment_cache> thread_segment_cache() {
+  static thread_local std::shared_ptr<segment_cache> cache = std::make_shared<segment_cache>();
+  return cache;
+}
+
+template <typename T> class caching_allocator {
+  template <typename U> friend class caching_allocator;
+
+  segment_cache *cache_pv;
+  // Set when the allocator shares ownership of the cache; null for a cache passed by reference.
+  std::shared_ptr<segment_cache> owner_pv;
+
+public:
+  using value_type = T;
+  using pointer = T *;
+  using const_pointer = T const *;
+  using reference = T &;
+  using const_reference = T const &;
+  using size_type = size_t;
+  using difference_type = ptrdiff_t;
+
+  template <typename U> struct rebind { using other = caching_allocator<U>; };
+
+  caching_allocator() : cache_pv(&shared_segment_cache()) {}
+  caching_allocator(segment_cache &cache) : cache_pv(&cache) {}
+  caching_allocator(std::shared_ptr<segment_cache> cache) : cache_pv(cache.get()), owner_pv(std::move(cache)) {}
+  template <typename U> caching_allocator(caching_allocator<U> const &other) : cache_pv(other.cache_pv), owner_pv(other.owner_pv) {}
+
+  T *allocate(size_t n) {
+    static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned types are not supported");
+    return static_cast<T *>(cache_pv->allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T *p, size_t n) noexcept { cache_pv->deallocate(p, n * sizeof(T)); }
+
+  template <typename U, typename... Ts> void construct(U *p, Ts &&... ts) { ::new (static_cast<void *>(p)) U(std::forward<Ts>(ts)...); }
+  template <typename U> void destroy(U *p) { p->~U(); }
+
+  segment_cache &cache() const { return *cache_pv; }
+
+  template <typename U> bool operator==(caching_allocator<U> const &o) const { return cache_pv == o.cache_pv; }
+  template <typename U> bool operator!=(caching_allocator<U> const &o) const { return cache_pv != o.cache_pv; }
+};
+} // namespace rpnx
+
+#endif
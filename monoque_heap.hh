@@ -0,0 +1,219 @@
+/*
+Monoque Heap
+
+Copyright (c) 2017, 2018 Ryan P. Nicholl <exaeta@protonmail.com> http://rpnx.net/
+ -- Please let me know if you find this structure useful, thanks!
+
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef RPNX_MONOQUE_HEAP_HH
+#define RPNX_MONOQUE_HEAP_HH
+
+#include "monoque.hh"
+#include <functional>
+
+/*
+  A binary heap stored in a monoque, with a priority_queue style interface.
+
+  Heap node i (counting from 1) is kept at monoque index i, leaving index 0
+  unused. With the default block layout, block k of the monoque then holds
+  exactly level k of the tree: [2^k, 2^(k+1)). The root is element 1 of block
+  0. A node is addressed as (level, offset), its children are at (level + 1,
+  2 * offset) and (level + 1, 2 * offset + 1), and its parent at
+  (level - 1, offset / 2), so sift-up and sift-down step through a table of
+  per level pointers instead of recomputing the block of every index.
+
+  pop_push(v) replaces the top with v in a single sift-down, and
+  push_range(first, last) heapifies bottom-up when it adds at least as many
+  elements as the heap already holds.
+ */
+
+namespace rpnx {
+template <typename T, typename Compare = std::less<T>, typename Allocator = std::allocator<T>> class monoque_heap : private Compare {
+public:
+  using container_type = monoque<T, Allocator>;
+  using value_compare = Compare;
+  using value_type = T;
+  using size_type = size_t;
+  using reference = T &;
+  using const_reference = T const &;
+
+private:
+  static_assert(container_type::layout::base_size == 2, "the heap layout relies on blocks of 2, 2, 4, 8, ... elements");
+
+  // The unused slot 0 holds the moved-from first value pushed, so T need be neither default constructible nor copyable.
+  container_type c_pv;
+  T *levels_pv[sizeof(T *) * 8];
+  size_t depth_pv;
+
+  Compare &comp_pv() { return *this; }
+
+  static size_t level_of_pv(size_t i) { return container_type::layout::log2(i); }
+
+  // Records the block of the level that heap node i, just pushed, belongs to.
+  void note_level_pv(size_t i) {
+    size_t k = level_of_pv(i);
+    if (rpnx_unlikely(k + 1 > depth_pv)) {
+      levels_pv[k] = k == 0 ? c_pv.segment(0).data() + 1 : c_pv.segment(k).data();
+      depth_pv = k + 1;
+    }
+  }
+
+  // Appends a node constructed from ts; the first one is built in slot 0 and moved on to node 1.
+  template <typename... Ts> void append_node_pv(Ts &&... ts) {
+    c_pv.emplace_back(std::forward<Ts>(ts)...);
+    if (c_pv.size() == 1)
+      c_pv.emplace_back(std::move(c_pv[0]));
+    note_level_pv(size());
+  }
+
+  // Moves v up from the hole at (k, o) until its parent is not less than it.
+  void sift_up_pv(size_t k, size_t o, T v) {
+    Compare &comp = comp_pv();
+    while (k != 0) {
+      T &parent = levels_pv[k - 1][o >> 1];
+      if (!comp(parent, v))
+        break;
+      levels_pv[k][o] = std::move(parent);
+      k--;
+      o >>= 1;
+    }
+    levels_pv[k][o] = std::move(v);
+  }
+
+  // Moves v down from the hole at (k, o) in a heap of n nodes.
+  void sift_down_pv(size_t k, size_t o, T v, size_t n) {
+    Compare &comp = comp_pv();
+    size_t last = level_of_pv(n);
+    size_t last_width = n - (size_t(1) << last) + 1;
+    for (;;) {
+      size_t c = o << 1;
+      size_t width = k + 1 < last ? (size_t(1) << (k + 1)) : k + 1 == last ? last_width : 0;
+      if (c >= width)
+        break;
+      T *row = levels_pv[k + 1];
+      if (c + 1 < width && comp(row[c], row[c + 1]))
+        c++;
+      if (!comp(v, row[c]))
+        break;
+      levels_pv[k][o] = std::move(row[c]);
+      k++;
+      o = c;
+    }
+    levels_pv[k][o] = std::move(v);
+  }
+
+  void heapify_pv() {
+    size_t n = size();
+    if (n < 2)
+      return;
+    size_t last = level_of_pv(n);
+    // Parents of the nodes on the last level, then every node above, bottom-up.
+    for (size_t k = last; k-- != 0;) {
+      size_t width = k + 1 == last ? (n - (size_t(1) << last) + 2) / 2 : size_t(1) << k;
+      for (size_t o = width; o-- != 0;)
+        sift_down_pv(k, o, std::move(levels_pv[k][o]), n);
+    }
+  }
+
+public:
+  monoque_heap() : Compare(), c_pv(), depth_pv(0) {}
+  explicit monoque_heap(Compare const &comp, Allocator const &alloc = Allocator()) : Compare(comp), c_pv(alloc), depth_pv(0) {}
+
+  template <typename It> monoque_heap(It first, It last, Compare const &comp = Compare(), Allocator const &alloc = Allocator()) : monoque_heap(comp, alloc) {
+    push_range(first, last);
+  }
+
+  monoque_heap(monoque_heap const &other) : Compare(other), c_pv(other.c_pv), depth_pv(0) {
+    for (size_t i = 1; i <= size(); i <<= 1)
+      note_level_pv(i);
+  }
+
+  monoque_heap(monoque_heap &&other) : monoque_heap(static_cast<Compare const &>(other), other.c_pv.get_allocator()) { swap(other); }
+
+  monoque_heap &operator=(monoque_heap other) {
+    swap(other);
+    return *this;
+  }
+
+  bool empty() const { return c_pv.empty(); }
+  size_type size() const { return c_pv.empty() ? 0 : c_pv.size() - 1; }
+
+  const_reference top() const { return levels_pv[0][0]; }
+
+  void push(T const &v) { emplace(v); }
+  void push(T &&v) { emplace(std::move(v)); }
+
+  template <typename... Ts> void emplace(Ts &&... ts) {
+    append_node_pv(std::forward<Ts>(ts)...);
+    size_t n = size();
+    size_t k = level_of_pv(n), o = n - (size_t(1) << k);
+    sift_up_pv(k, o, std::move(levels_pv[k][o]));
+  }
+
+  void pop() {
+    size_t n = size();
+    if (n == 1) {
+      clear();
+      return;
+    }
+    T v = std::move(c_pv.back());
+    c_pv.pop_back();
+    sift_down_pv(0, 0, std::move(v), n - 1);
+  }
+
+  // Same as pop() followed by push(v), but with a single sift-down. Requires !empty().
+  void pop_push(T v) { sift_down_pv(0, 0, std::move(v), size()); }
+
+  template <typename It> void push_range(It first, It last) {
+    size_t old = size();
+    for (; first != last; ++first)
+      append_node_pv(*first);
+    size_t n = size();
+    if (n - old >= old) {
+      heapify_pv();
+      return;
+    }
+    for (size_t i = old + 1; i <= n; i++) {
+      size_t k = level_of_pv(i);
+      sift_up_pv(k, i - (size_t(1) << k), std::move(levels_pv[k][i - (size_t(1) << k)]));
+    }
+  }
+
+  // Keeps the blocks, like monoque::clear().
+  void clear() { c_pv.clear(); }
+
+  void swap(monoque_heap &other) {
+    using std::swap;
+    swap(static_cast<Compare &>(*this), static_cast<Compare &>(other));
+    c_pv.swap(other.c_pv);
+    std::swap(levels_pv, other.levels_pv);
+    std::swap(depth_pv, other.depth_pv);
+  }
+
+  friend void swap(monoque_heap &a, monoque_heap &b) { a.swap(b); }
+
+  // The monoque holding the nodes; element 0 is padding and [1, size()] is the heap in level order.
+  container_type const &container() const { return c_pv; }
+};
+} // namespace rpnx
+
+#endif
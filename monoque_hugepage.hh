@@ -0,0 +1,150 @@
+/*
+Monoque Huge Page Allocator
+
+Copyright (c) 2017, 2018 Ryan P. Nicholl <exaeta@protonmail.com> http://rpnx.net/
+ -- Please let me know if you find this structure useful, thanks!
+
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef RPNX_MONOQUE_HUGEPAGE_HH
+#define RPNX_MONOQUE_HUGEPAGE_HH
+
+#include "monoque.hh"
+#include <cstddef>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+  Block allocation policy for large monoques.
+
+  Blocks smaller than HugeThreshold bytes come from aligned operator new
+  with at least Alignment byte alignment (a cache line by default). Larger
+  blocks are mapped directly, aligned to 2 MiB, and either:
+
+    huge_pages::none         plain pages
+    huge_pages::transparent  madvise(MADV_HUGEPAGE)
+    huge_pages::explicit_    MAP_HUGETLB, falling back to transparent when
+                             the reserved huge page pool is exhausted
+
+  With Prefault, every page of a new block is touched before it is handed to
+  the monoque, so the push_back that opens a block pays the page faults
+  up front instead of spreading them over the pushes that follow.
+
+  Only Linux honours the huge page requests; elsewhere they are ignored.
+ */
+
+namespace rpnx {
+enum class huge_pages { none, transparent, explicit_ };
+
+template <typename T, size_t Alignment = 64, size_t HugeThreshold = (size_t(2) << 20), huge_pages Mode = huge_pages::transparent,
+          bool Prefault = false>
+class hugepage_allocator {
+  static_assert((Alignment & (Alignment - 1)) == 0, "Alignment must be a power of two");
+
+  static constexpr size_t huge_size_pv = size_t(2) << 20;
+  static constexpr size_t alignment_pv = Alignment > alignof(T) ? Alignment : alignof(T);
+
+  static size_t mapped_bytes_pv(size_t bytes) { return (bytes + huge_size_pv - 1) / huge_size_pv * huge_size_pv; }
+
+  static void prefault_pv(void *p, size_t bytes) {
+    size_t page = size_t(sysconf(_SC_PAGESIZE));
+    volatile char *c = static_cast<char *>(p);
+    for (size_t i = 0; i < bytes; i += page)
+      c[i] = 0;
+  }
+
+  // A mapping of exactly len bytes starting on a 2 MiB boundary.
+  static void *map_aligned_pv(size_t len) {
+    size_t over = len + huge_size_pv;
+    void *raw = mmap(nullptr, over, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+      throw std::bad_alloc();
+    uintptr_t start = (uintptr_t(raw) + huge_size_pv - 1) & ~uintptr_t(huge_size_pv - 1);
+    size_t head = start - uintptr_t(raw);
+    if (head != 0)
+      munmap(raw, head);
+    if (over - head - len != 0)
+      munmap(reinterpret_cast<void *>(start + len), over - head - len);
+    return reinterpret_cast<void *>(start);
+  }
+
+  static void *map_pv(size_t bytes) {
+    size_t len = mapped_bytes_pv(bytes);
+    void *p = nullptr;
+#if defined(MAP_HUGETLB)
+    if (Mode == huge_pages::explicit_) {
+      p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (Prefault ? MAP_POPULATE : 0), -1, 0);
+      if (p != MAP_FAILED)
+        return p;
+    }
+#endif
+    p = map_aligned_pv(len);
+#if defined(MADV_HUGEPAGE)
+    if (Mode != huge_pages::none)
+      madvise(p, len, MADV_HUGEPAGE);
+#endif
+    if (Prefault)
+      prefault_pv(p, len);
+    return p;
+  }
+
+public:
+  using value_type = T;
+  using pointer = T *;
+  using const_pointer = T const *;
+  using reference = T &;
+  using const_reference = T const &;
+  using size_type = size_t;
+  using difference_type = ptrdiff_t;
+
+  template <typename U> struct rebind { using other = hugepage_allocator<U, Alignment, HugeThreshold, Mode, Prefault>; };
+
+  hugepage_allocator() {}
+  template <typename U> hugepage_allocator(hugepage_allocator<U, Alignment, HugeThreshold, Mode, Prefault> const &) {}
+
+  T *allocate(size_t n) {
+    size_t bytes = n * sizeof(T);
+    if (bytes >= HugeThreshold)
+      return static_cast<T *>(map_pv(bytes));
+    void *p = ::operator new(bytes, std::align_val_t(alignment_pv));
+    if (Prefault)
+      prefault_pv(p, bytes);
+    return static_cast<T *>(p);
+  }
+
+  void deallocate(T *p, size_t n) {
+    size_t bytes = n * sizeof(T);
+    if (bytes >= HugeThreshold)
+      munmap(p, mapped_bytes_pv(bytes));
+    else
+      ::operator delete(p, std::align_val_t(alignment_pv));
+  }
+
+  template <typename U, typename... Ts> void construct(U *p, Ts &&... ts) { ::new (static_cast<void *>(p)) U(std::forward<Ts>(ts)...); }
+  template <typename U> void destroy(U *p) { p->~U(); }
+
+  template <typename U> bool operator==(hugepage_allocator<U, Alignment, HugeThreshold, Mode, Prefault> const &) const { return true; }
+  template <typename U> bool operator!=(hugepage_allocator<U, Alignment, HugeThreshold, Mode, Prefault> const &) const { return false; }
+};
+} // namespace rpnx
+
+#endif
@@ -0,0 +1,214 @@
+/*
+Monoque Serialization
+
+Copyright (c) 2017, 2018 Ryan P. Nicholl <exaeta@protonmail.com> http://rpnx.net/
+ -- Please let me know if you find this structure useful, thanks!
+
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef RPNX_MONOQUE_IO_HH
+#define RPNX_MONOQUE_IO_HH
+
+#include "monoque.hh"
+#include <errno.h>
+#include <stdexcept>
+#include <system_error>
+#include <unistd.h>
+
+/*
+  Append-only binary format for monoques of trivially copyable elements.
+
+  A stream is a header followed by records. Each record holds a run of
+  elements [first, first + count) that lies inside one monoque block, the
+  run's checksum, and the raw element bytes. Records must follow each other
+  without gaps, so a checkpoint is just more records appended to the end:
+
+    save(fd, m);                      // header + every block
+    ...                               // m grows
+    checkpoint_since(fd, m, old);     // only [old, m.size())
+    ...
+    load(fd, m2);                     // replays every record
+
+  Blocks other than the last are never modified by push_back, which is what
+  makes writing only the tail sufficient. Elements changed in place below
+  prev_size are not captured by checkpoint_since(); call save() on a fresh
+  file instead. The byte order, element layout and block layout are those of
+  the writer; load() rejects a record whose run does not fit in one block.
+ */
+
+namespace rpnx {
+struct monoque_io {
+  struct header {
+    char magic[8];
+    uint32_t version;
+    uint32_t element_size;
+  };
+
+  struct record {
+    uint64_t first;
+    uint64_t count;
+    uint64_t checksum;
+  };
+
+  static constexpr uint32_t version = 1;
+
+  // 64-bit multiply/xor hash over 8-byte words, much faster than a byte-wise CRC. Data may be fed in pieces.
+  class hasher {
+    uint64_t h = 0xcbf29ce484222325ull;
+    unsigned char tail[8];
+    size_t ntail = 0;
+
+    void word(uint64_t w) {
+      h = (h ^ w) * 0x100000001b3ull;
+      h ^= h >> 29;
+    }
+
+  public:
+    void update(void const *data, size_t bytes) {
+      unsigned char const *p = static_cast<unsigned char const *>(data);
+      for (; ntail != 0 && ntail < 8 && bytes != 0; bytes--)
+        tail[ntail++] = *p++;
+      if (ntail == 8) {
+        uint64_t w;
+        memcpy(&w, tail, 8);
+        word(w);
+        ntail = 0;
+      }
+      for (; bytes >= 8; bytes -= 8, p += 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        word(w);
+      }
+      for (; bytes != 0; bytes--)
+        tail[ntail++] = *p++;
+    }
+
+    uint64_t finish() const {
+      uint64_t r = h;
+      for (size_t i = 0; i != ntail; i++)
+        r = (r ^ tail[i]) * 0x100000001b3ull;
+      return r;
+    }
+  };
+
+  static uint64_t checksum(void const *data, size_t bytes) {
+    hasher hs;
+    hs.update(data, bytes);
+    return hs.finish();
+  }
+
+  static void write_all(int fd, void const *data, size_t bytes) {
+    char const *p = static_cast<char const *>(data);
+    while (bytes != 0) {
+      ssize_t n = ::write(fd, p, bytes);
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        throw std::system_error(errno, std::generic_category(), "monoque_io: write");
+      }
+      p += n;
+      bytes -= size_t(n);
+    }
+  }
+
+  // Returns false on a clean end of stream before any byte was read.
+  static bool read_all(int fd, void *data, size_t bytes) {
+    char *p = static_cast<char *>(data);
+    size_t want = bytes;
+    while (bytes != 0) {
+      ssize_t n = ::read(fd, p, bytes);
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        throw std::system_error(errno, std::generic_category(), "monoque_io: read");
+      }
+      if (n == 0) {
+        if (bytes == want)
+          return false;
+        throw std::runtime_error("monoque_io: truncated stream");
+      }
+      p += n;
+      bytes -= size_t(n);
+    }
+    return true;
+  }
+};
+
+// Appends records for the elements [prev_size, m.size()) of m to fd.
+template <typename Monoque> void checkpoint_since(int fd, Monoque const &m, size_t prev_size) {
+  using T = typename Monoque::value_type;
+  static_assert(std::is_trivially_copyable<T>::value, "monoque serialization requires trivially copyable elements");
+
+  size_t first = prev_size;
+  m.for_each_segment(prev_size, m.size(), [&](T const *p, size_t n) {
+    monoque_io::record r = {uint64_t(first), uint64_t(n), monoque_io::checksum(p, n * sizeof(T))};
+    monoque_io::write_all(fd, &r, sizeof(r));
+    monoque_io::write_all(fd, p, n * sizeof(T));
+    first += n;
+  });
+}
+
+// Writes a stream header followed by every element of m.
+template <typename Monoque> void save(int fd, Monoque const &m) {
+  using T = typename Monoque::value_type;
+  static_assert(std::is_trivially_copyable<T>::value, "monoque serialization requires trivially copyable elements");
+  monoque_io::header h = {{'R', 'P', 'N', 'X', 'M', 'Q', 'S', '1'}, monoque_io::version, uint32_t(sizeof(T))};
+  monoque_io::write_all(fd, &h, sizeof(h));
+  checkpoint_since(fd, m, 0);
+}
+
+// Replaces the contents of m with the stream read from fd, reading each record straight into its block.
+template <typename Monoque> void load(int fd, Monoque &m) {
+  using T = typename Monoque::value_type;
+  static_assert(std::is_trivially_copyable<T>::value, "monoque serialization requires trivially copyable elements");
+
+  monoque_io::header h;
+  if (!monoque_io::read_all(fd, &h, sizeof(h)) || memcmp(h.magic, "RPNXMQS1", 8) != 0 || h.version != monoque_io::version)
+    throw std::runtime_error("monoque_io: not a monoque stream");
+  if (h.element_size != sizeof(T))
+    throw std::runtime_error("monoque_io: element size mismatch");
+
+  Monoque result(m.get_allocator());
+  monoque_io::record r;
+  while (monoque_io::read_all(fd, &r, sizeof(r))) {
+    if (r.first != result.size())
+      throw std::runtime_error("monoque_io: records out of order");
+    // The writer never emits an empty run or one that leaves its block; anything else is corrupt, and must be
+    // rejected before it sizes the allocation.
+    size_t k, off;
+    std::tie(k, off) = Monoque::layout::index(size_t(r.first));
+    if (r.count == 0 || r.count > Monoque::layout::segment_capacity(k) - off)
+      throw std::runtime_error("monoque_io: corrupt record");
+
+    monoque_io::hasher hs;
+    result.append_with(size_t(r.count), [&](T *p, size_t n) {
+      if (!monoque_io::read_all(fd, p, n * sizeof(T)))
+        throw std::runtime_error("monoque_io: truncated stream");
+      hs.update(p, n * sizeof(T));
+    });
+    if (hs.finish() != r.checksum)
+      throw std::runtime_error("monoque_io: checksum mismatch");
+  }
+  m.swap(result);
+}
+} // namespace rpnx
+
+#endif
@@ -0,0 +1,343 @@
+/*
+Monoque Parallel Algorithms
+
+Copyright (c) 2017, 2018 Ryan P. Nicholl <exaeta@protonmail.com> http://rpnx.net/
+ -- Please let me know if you find this structure useful, thanks!
+
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef RPNX_MONOQUE_PARALLEL_HH
+#define RPNX_MONOQUE_PARALLEL_HH
+
+#include "monoque.hh"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+  Parallel for_each / transform / reduce / inclusive_scan over monoques.
+
+  The index range [0, size()) is cut into chunks of equal element count, so a
+  chunk may cover many small blocks or part of a large one. Each chunk is
+  walked with for_each_segment, i.e. as plain pointer loops. Chunks are
+  spread over a work-stealing thread_pool; the calling thread takes part.
+
+  reduce and inclusive_scan require an associative op, like std::reduce.
+  Partial results are combined in index order, so op need not commute.
+ */
+
+namespace rpnx {
+namespace parallel {
+
+class thread_pool {
+  struct job_pv {
+    void (*call)(void *, size_t);
+    void *ctx;
+    std::atomic<size_t> remaining;
+    std::mutex m;
+    std::condition_variable done;
+    std::exception_ptr error;
+  };
+
+  struct task_pv {
+    job_pv *job;
+    size_t index;
+  };
+
+  struct worker_pv {
+    std::mutex m;
+    std::deque<task_pv> q;
+  };
+
+  std::vector<std::unique_ptr<worker_pv>> queues_pv;
+  std::vector<std::thread> threads_pv;
+  std::mutex sleep_m_pv;
+  std::condition_variable wake_pv;
+  std::atomic<size_t> pending_pv;
+  bool stop_pv;
+
+  // Owners take from the back of their own queue, thieves from the front of another.
+  bool take_pv(size_t self, task_pv &t) {
+    size_t n = queues_pv.size();
+    for (size_t j = 0; j != n; j++) {
+      worker_pv &w = *queues_pv[(self + j) % n];
+      std::lock_guard<std::mutex> lock(w.m);
+      if (w.q.empty())
+        continue;
+      if (j == 0) {
+        t = w.q.back();
+        w.q.pop_back();
+      } else {
+        t = w.q.front();
+        w.q.pop_front();
+      }
+      pending_pv.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+    return false;
+  }
+
+  static void execute_pv(task_pv const &t) {
+    job_pv &job = *t.job;
+    std::exception_ptr error;
+    try {
+      job.call(job.ctx, t.index);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    // The job lives on the stack of run(), which cannot return while we hold its mutex.
+    std::lock_guard<std::mutex> lock(job.m);
+    if (error && !job.error)
+      job.error = error;
+    if (job.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      job.done.notify_all();
+  }
+
+  void worker_main_pv(size_t self) {
+    for (;;) {
+      task_pv t;
+      if (take_pv(self, t)) {
+        execute_pv(t);
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(sleep_m_pv);
+      wake_pv.wait(lock, [&] { return stop_pv || pending_pv.load(std::memory_order_relaxed) != 0; });
+      if (stop_pv)
+        return;
+    }
+  }
+
+public:
+  // threads workers plus the thread calling run(); threads may be 0.
+  explicit thread_pool(size_t threads = std::thread::hardware_concurrency()) : pending_pv(0), stop_pv(false) {
+    for (size_t i = 0; i != threads + 1; i++)
+      queues_pv.emplace_back(new worker_pv);
+    for (size_t i = 0; i != threads; i++)
+      threads_pv.emplace_back([this, i] { worker_main_pv(i + 1); });
+  }
+
+  thread_pool(thread_pool const &) = delete;
+  thread_pool &operator=(thread_pool const &) = delete;
+
+  ~thread_pool() {
+    {
+      std::lock_guard<std::mutex> lock(sleep_m_pv);
+      stop_pv = true;
+    }
+    wake_pv.notify_all();
+    for (auto &t : threads_pv)
+      t.join();
+  }
+
+  // Number of threads that execute tasks, including the caller of run().
+  size_t concurrency() const { return queues_pv.size(); }
+
+  // Calls f(i) for every i in [0, n) and returns once all calls have finished, rethrowing the first exception.
+  template <typename F> void run(size_t n, F &&f) {
+    if (n == 0)
+      return;
+
+    job_pv job;
+    job.call = [](void *ctx, size_t i) { (*static_cast<typename std::remove_reference<F>::type *>(ctx))(i); };
+    job.ctx = const_cast<void *>(static_cast<void const volatile *>(&f));
+    job.remaining.store(n, std::memory_order_relaxed);
+
+    // Hand each queue a contiguous run of indices so neighbouring chunks tend to stay on one thread.
+    size_t w = queues_pv.size();
+    for (size_t q = 0; q != w; q++) {
+      std::lock_guard<std::mutex> lock(queues_pv[q]->m);
+      for (size_t i = n * q / w, e = n * (q + 1) / w; i != e; i++)
+        queues_pv[q]->q.push_back(task_pv{&job, i});
+    }
+    {
+      std::lock_guard<std::mutex> lock(sleep_m_pv);
+      pending_pv.fetch_add(n, std::memory_order_relaxed);
+    }
+    wake_pv.notify_all();
+
+    task_pv t;
+    while (job.remaining.load(std::memory_order_acquire) != 0 && take_pv(0, t))
+      execute_pv(t);
+
+    std::unique_lock<std::mutex> lock(job.m);
+    job.done.wait(lock, [&] { return job.remaining.load(std::memory_order_acquire) == 0; });
+    if (job.error)
+      std::rethrow_exception(job.error);
+  }
+};
+
+inline thread_pool &default_pool() {
+  static thread_pool pool(std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0);
+  return pool;
+}
+
+// Elements per chunk below which splitting further costs more than it gains.
+constexpr size_t min_chunk = 16384;
+
+// Splits [0, n) into equal chunks and calls f(first, last) for each on pool.
+template <typename F> void for_each_chunk(size_t n, F &&f, thread_pool &pool = default_pool()) {
+  size_t chunks = std::min(pool.concurrency() * 4, (n + min_chunk - 1) / min_chunk);
+  if (chunks <= 1) {
+    if (n != 0)
+      f(size_t(0), n);
+    return;
+  }
+  pool.run(chunks, [&](size_t c) { f(n * c / chunks, n * (c + 1) / chunks); });
+}
+
+template <typename Monoque, typename F> void for_each(Monoque &m, F f, thread_pool &pool = default_pool()) {
+  using T = typename std::remove_reference<decltype(m[0])>::type;
+  for_each_chunk(m.size(),
+                 [&](size_t first, size_t last) {
+                   m.for_each_segment(first, last, [&](T *p, size_t n) {
+                     for (size_t i = 0; i != n; i++)
+                       f(p[i]);
+                   });
+                 },
+                 pool);
+}
+
+/*
+  Calls f(T const *in, U *out, size_t n) for each run of [first, last) that is contiguous in both src
+  and dst, so the two may use different block layouts (BaseSize, Index, or another container).
+ */
+template <typename Src, typename Dst, typename F> void for_each_zipped_run_pv(Src const &src, Dst &dst, size_t first, size_t last, F &&f) {
+  using T = typename Src::value_type;
+  using U = typename Dst::value_type;
+  src.for_each_segment(first, last, [&](T const *p, size_t n) {
+    dst.for_each_segment(first, first + n, [&](U *out, size_t m) {
+      f(p, out, m);
+      p += m;
+    });
+    first += n;
+  });
+}
+
+// dst[i] = f(src[i]) for every i; dst is resized to src.size(). src and dst may be the same monoque.
+template <typename Src, typename Dst, typename F> void transform(Src const &src, Dst &dst, F f, thread_pool &pool = default_pool()) {
+  using T = typename Src::value_type;
+  using U = typename Dst::value_type;
+  if (static_cast<void const *>(&src) != static_cast<void const *>(&dst))
+    dst.resize(src.size());
+  for_each_chunk(src.size(),
+                 [&](size_t first, size_t last) {
+                   for_each_zipped_run_pv(src, dst, first, last, [&](T const *p, U *out, size_t n) {
+                     for (size_t i = 0; i != n; i++)
+                       out[i] = f(p[i]);
+                   });
+                 },
+                 pool);
+}
+
+template <typename Monoque, typename V, typename Op> V reduce(Monoque const &m, V init, Op op, thread_pool &pool = default_pool()) {
+  using T = typename Monoque::value_type;
+  size_t chunks = std::min(pool.concurrency() * 4, (m.size() + min_chunk - 1) / min_chunk);
+  if (chunks <= 1) {
+    m.for_each_segment([&](T const *p, size_t n) {
+      for (size_t i = 0; i != n; i++)
+        init = op(init, p[i]);
+    });
+    return init;
+  }
+
+  // Each chunk folds onto its own first element, so no identity value is needed.
+  std::vector<V> partial;
+  partial.reserve(chunks);
+  for (size_t c = 0; c != chunks; c++)
+    partial.emplace_back(m[m.size() * c / chunks]);
+  pool.run(chunks, [&](size_t c) {
+    size_t first = m.size() * c / chunks + 1, last = m.size() * (c + 1) / chunks;
+    V acc = partial[c];
+    m.for_each_segment(first, last, [&](T const *p, size_t n) {
+      for (size_t i = 0; i != n; i++)
+        acc = op(acc, p[i]);
+    });
+    partial[c] = acc;
+  });
+
+  for (auto &x : partial)
+    init = op(init, x);
+  return init;
+}
+
+template <typename Monoque> typename Monoque::value_type reduce(Monoque const &m, thread_pool &pool = default_pool()) {
+  using T = typename Monoque::value_type;
+  return parallel::reduce(m, T(), [](T const &a, T const &b) { return a + b; }, pool);
+}
+
+// dst[i] = src[0] op src[1] op ... op src[i]; dst is resized to src.size(). src and dst may be the same monoque.
+template <typename Src, typename Dst, typename Op> void inclusive_scan(Src const &src, Dst &dst, Op op, thread_pool &pool = default_pool()) {
+  using T = typename Src::value_type;
+  using U = typename Dst::value_type;
+  size_t size = src.size();
+  if (static_cast<void const *>(&src) != static_cast<void const *>(&dst))
+    dst.resize(size);
+  if (size == 0)
+    return;
+
+  auto scan = [&](size_t first, size_t last) {
+    U acc = src[first];
+    dst[first] = acc;
+    for_each_zipped_run_pv(src, dst, first + 1, last, [&](T const *p, U *out, size_t n) {
+      for (size_t i = 0; i != n; i++) {
+        acc = op(acc, p[i]);
+        out[i] = acc;
+      }
+    });
+  };
+
+  size_t chunks = std::min(pool.concurrency() * 4, (size + min_chunk - 1) / min_chunk);
+  if (chunks <= 1) {
+    scan(0, size);
+    return;
+  }
+
+  // Pass 1 scans every chunk independently; pass 2 folds the preceding chunks' total into all but the first.
+  std::vector<U> carry;
+  carry.reserve(chunks);
+  pool.run(chunks, [&](size_t c) { scan(size * c / chunks, size * (c + 1) / chunks); });
+  carry.push_back(dst[size / chunks - 1]);
+  for (size_t c = 1; c + 1 < chunks; c++)
+    carry.push_back(op(carry.back(), dst[size * (c + 1) / chunks - 1]));
+
+  pool.run(chunks - 1, [&](size_t c) {
+    size_t first = size * (c + 1) / chunks, last = size * (c + 2) / chunks;
+    U const &prefix = carry[c];
+    dst.for_each_segment(first, last, [&](U *p, size_t n) {
+      for (size_t i = 0; i != n; i++)
+        p[i] = op(prefix, p[i]);
+    });
+  });
+}
+
+template <typename Monoque> void inclusive_scan(Monoque &m, thread_pool &pool = default_pool()) {
+  using T = typename Monoque::value_type;
+  parallel::inclusive_scan(m, m, [](T const &a, T const &b) { return a + b; }, pool);
+}
+
+} // namespace parallel
+} // namespace rpnx
+
+#endif
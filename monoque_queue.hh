@@ -0,0 +1,259 @@
+/*
+Monoque Queue
+
+Copyright (c) 2017, 2018 Ryan P. Nicholl <exaeta@protonmail.com> http://rpnx.net/
+ -- Please let me know if you find this structure useful, thanks!
+
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef RPNX_MONOQUE_QUEUE_HH
+#define RPNX_MONOQUE_QUEUE_HH
+
+#include "monoque.hh"
+
+/*
+  A FIFO queue with monoque's growth pattern and memory that follows the
+  live element count instead of the number of elements ever pushed.
+
+  Elements live in a short chain of power-of-two blocks. A block opened by
+  push_back holds at least as many elements as the queue does at that
+  moment, so the chain keeps doubling while the queue grows and has at most
+  a few dozen blocks. pop_front never moves an element; once the head block
+  is fully consumed it is dropped from the chain. It is kept as the one spare
+  block, which the next push_back that needs a block takes over instead of
+  calling the allocator, only if it is at most twice the block the current
+  size would need; a larger one is freed at once, and so is a spare too big
+  for the block being opened.
+
+  Retained memory is therefore the blocks that still hold live elements plus
+  one spare of at most 2 * max(min_block, ceil_pow2(size)) elements, size
+  taken when the spare was kept. Blocks from a burst are freed as soon as
+  they are consumed, and a queue that has drained to empty holds at most
+  2 * min_block elements' worth (min_block is 1 KiB of elements, at least 16).
+
+  push_back is O(1) worst case apart from the allocation of a new block, as
+  for monoque; pop_front is always O(1).
+ */
+
+namespace rpnx {
+template <typename T, typename Allocator = std::allocator<T>> class monoque_queue : private Allocator {
+public:
+  using value_type = T;
+  using allocator_type = Allocator;
+  using size_type = size_t;
+  using reference = T &;
+  using const_reference = T const &;
+
+private:
+  using traits_pv = std::allocator_traits<Allocator>;
+
+  struct block_pv {
+    T *p;
+    size_t cap;
+  };
+
+  // Each block holds at least as many elements as all blocks before it, which bounds the chain length.
+  static constexpr size_t max_blocks_pv = sizeof(void *) * 8 + 8;
+  static constexpr size_t min_block_pv = sizeof(T) >= 64 ? 16 : 1024 / sizeof(T);
+
+  std::array<block_pv, max_blocks_pv> ring_pv;
+  size_t first_pv;
+  size_t blocks_pv;
+  size_t head_pv;
+  size_t tail_pv;
+  size_t size_pv;
+  block_pv spare_pv;
+
+  block_pv &head_block_pv() { return ring_pv[first_pv]; }
+  block_pv &tail_block_pv() { return ring_pv[(first_pv + blocks_pv - 1) % max_blocks_pv]; }
+  block_pv const &head_block_pv() const { return ring_pv[first_pv]; }
+  block_pv const &tail_block_pv() const { return ring_pv[(first_pv + blocks_pv - 1) % max_blocks_pv]; }
+
+  static size_t ceil_pow2_pv(size_t n) {
+    size_t c = 1;
+    while (c < n)
+      c <<= 1;
+    return c;
+  }
+
+  void free_spare_pv() {
+    if (spare_pv.p != nullptr)
+      traits_pv::deallocate(*this, spare_pv.p, spare_pv.cap);
+    spare_pv = block_pv{nullptr, 0};
+  }
+
+  // The block a queue of n elements opens, and the largest block it keeps as the spare.
+  static size_t block_for_pv(size_t n) { return std::max(min_block_pv, ceil_pow2_pv(n)); }
+
+  void open_block_pv() {
+    assert(blocks_pv < max_blocks_pv);
+    size_t need = block_for_pv(size_pv);
+    block_pv b;
+    if (spare_pv.p != nullptr && spare_pv.cap >= need && spare_pv.cap <= 2 * need) {
+      b = spare_pv;
+      spare_pv = block_pv{nullptr, 0};
+    } else {
+      if (spare_pv.cap > 2 * need)
+        free_spare_pv();
+      b = block_pv{traits_pv::allocate(*this, need), need};
+    }
+    ring_pv[(first_pv + blocks_pv) % max_blocks_pv] = b;
+    blocks_pv++;
+    tail_pv = 0;
+  }
+
+  // Drops the consumed head block from the chain, keeping it as the spare if it is the better one and not too big.
+  void close_head_pv() {
+    block_pv b = head_block_pv();
+    first_pv = (first_pv + 1) % max_blocks_pv;
+    blocks_pv--;
+    head_pv = 0;
+
+    size_t keep = 2 * block_for_pv(size_pv);
+    if (spare_pv.cap > keep)
+      free_spare_pv();
+    if (b.cap <= keep && (spare_pv.p == nullptr || spare_pv.cap < b.cap)) {
+      free_spare_pv();
+      spare_pv = b;
+    } else {
+      traits_pv::deallocate(*this, b.p, b.cap);
+    }
+  }
+
+public:
+  monoque_queue() : monoque_queue(allocator_type()) {}
+  explicit monoque_queue(allocator_type const &alloc)
+      : Allocator(alloc), first_pv(0), blocks_pv(0), head_pv(0), tail_pv(0), size_pv(0), spare_pv{nullptr, 0} {}
+
+  monoque_queue(monoque_queue const &other) : monoque_queue(traits_pv::select_on_container_copy_construction(other.get_allocator())) {
+    other.for_each_segment([&](T const *p, size_t n) {
+      for (size_t i = 0; i != n; i++)
+        push_back(p[i]);
+    });
+  }
+
+  monoque_queue(monoque_queue &&other) : monoque_queue(other.get_allocator()) { swap(other); }
+
+  monoque_queue &operator=(monoque_queue other) {
+    swap(other);
+    return *this;
+  }
+
+  ~monoque_queue() {
+    clear();
+    free_spare_pv();
+  }
+
+  allocator_type const &get_allocator() const { return *this; }
+
+  bool empty() const { return size_pv == 0; }
+  size_type size() const { return size_pv; }
+
+  // Elements the queue can hold without allocating, counting the spare block.
+  size_type capacity() const {
+    size_t c = spare_pv.cap;
+    for (size_t i = 0; i != blocks_pv; i++)
+      c += ring_pv[(first_pv + i) % max_blocks_pv].cap;
+    return c;
+  }
+
+  reference front() { return head_block_pv().p[head_pv]; }
+  const_reference front() const { return head_block_pv().p[head_pv]; }
+  reference back() { return tail_block_pv().p[tail_pv - 1]; }
+  const_reference back() const { return tail_block_pv().p[tail_pv - 1]; }
+
+  template <typename... Ts> void emplace_back(Ts &&... ts) {
+    if (rpnx_unlikely(blocks_pv == 0 || tail_pv == tail_block_pv().cap))
+      open_block_pv();
+    traits_pv::construct(*this, tail_block_pv().p + tail_pv, std::forward<Ts>(ts)...);
+    tail_pv++;
+    size_pv++;
+  }
+
+  void push_back(T const &v) { emplace_back(v); }
+  void push_back(T &&v) { emplace_back(std::move(v)); }
+
+  void pop_front() {
+    assert(size_pv != 0);
+    traits_pv::destroy(*this, head_block_pv().p + head_pv);
+    head_pv++;
+    size_pv--;
+    if (rpnx_unlikely(head_pv == head_block_pv().cap || size_pv == 0)) {
+      if (size_pv == 0)
+        tail_pv = 0;
+      close_head_pv();
+    }
+  }
+
+  // std::queue spellings, so monoque_queue can stand in for std::queue<T, std::deque<T>>.
+  void push(T const &v) { push_back(v); }
+  void push(T &&v) { push_back(std::move(v)); }
+  template <typename... Ts> void emplace(Ts &&... ts) { emplace_back(std::forward<Ts>(ts)...); }
+  void pop() { pop_front(); }
+
+  void clear() {
+    while (size_pv != 0)
+      pop_front();
+  }
+
+  // Frees the spare block.
+  void shrink_to_fit() { free_spare_pv(); }
+
+  // Calls f(T *data, size_t n) for each contiguous run of elements, front to back.
+  template <typename F> void for_each_segment(F &&f) {
+    for (size_t i = 0; i != blocks_pv; i++) {
+      block_pv &b = ring_pv[(first_pv + i) % max_blocks_pv];
+      size_t from = i == 0 ? head_pv : 0, to = i + 1 == blocks_pv ? tail_pv : b.cap;
+      if (from != to)
+        f(b.p + from, to - from);
+    }
+  }
+
+  template <typename F> void for_each_segment(F &&f) const {
+    for (size_t i = 0; i != blocks_pv; i++) {
+      block_pv const &b = ring_pv[(first_pv + i) % max_blocks_pv];
+      size_t from = i == 0 ? head_pv : 0, to = i + 1 == blocks_pv ? tail_pv : b.cap;
+      if (from != to)
+        f(static_cast<T const *>(b.p + from), to - from);
+    }
+  }
+
+  // Allocators are exchanged only if they propagate on swap; otherwise they must compare equal.
+  void swap(monoque_queue &other) {
+    if constexpr (traits_pv::propagate_on_container_swap::value) {
+      using std::swap;
+      swap(static_cast<allocator_type &>(*this), static_cast<allocator_type &>(other));
+    }
+    assert(traits_pv::propagate_on_container_swap::value || get_allocator() == other.get_allocator());
+    std::swap(ring_pv, other.ring_pv);
+    std::swap(first_pv, other.first_pv);
+    std::swap(blocks_pv, other.blocks_pv);
+    std::swap(head_pv, other.head_pv);
+    std::swap(tail_pv, other.tail_pv);
+    std::swap(size_pv, other.size_pv);
+    std::swap(spare_pv, other.spare_pv);
+  }
+
+  friend void swap(monoque_queue &a, monoque_queue &b) { a.swap(b); }
+};
+} // namespace rpnx
+
+#endif
@@ -0,0 +1,284 @@
+/*
+Monoque SIMD Kernels
+
+Copyright (c) 2017, 2018 Ryan P. Nicholl <exaeta@protonmail.com> http://rpnx.net/
+ -- Please let me know if you find this structure useful, thanks!
+
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef RPNX_MONOQUE_SIMD_HH
+#define RPNX_MONOQUE_SIMD_HH
+
+#include "monoque.hh"
+#include <limits>
+
+/*
+  Vectorized sum / min / max / count / find / find_if over monoques of
+  arithmetic type.
+
+  Every kernel is written once as a loop over a fixed number of independent
+  lanes (one 64 byte line of elements), which the compiler turns into SIMD
+  code without needing to reassociate floating point math. The same loop is
+  compiled for SSE2, AVX2 and AVX-512, and the widest one the CPU supports is
+  picked at runtime. Runs shorter than small_run elements, such as the 2, 2,
+  4, 8 element leading blocks, take the plain scalar loop and skip dispatch.
+
+  Floating point sums are therefore added lane by lane and are not bit
+  identical to std::accumulate. Sums are accumulated in T.
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RPNX_SIMD_X86 1
+#define RPNX_SIMD_INLINE inline __attribute__((always_inline))
+#else
+#define RPNX_SIMD_X86 0
+#define RPNX_SIMD_INLINE inline
+#endif
+
+namespace rpnx {
+namespace simd {
+
+enum class isa { scalar, sse2, avx2, avx512 };
+
+inline isa &isa_override_pv() {
+  static isa level = isa::avx512;
+  return level;
+}
+
+inline isa supported_isa() {
+#if RPNX_SIMD_X86
+  static isa const level = [] {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl"))
+      return isa::avx512;
+    if (__builtin_cpu_supports("avx2"))
+      return isa::avx2;
+    if (__builtin_cpu_supports("sse2"))
+      return isa::sse2;
+    return isa::scalar;
+  }();
+  return level;
+#else
+  return isa::scalar;
+#endif
+}
+
+// The kernel set in use: the widest supported one, capped by set_isa().
+inline isa active_isa() { return std::min(supported_isa(), isa_override_pv()); }
+
+// Caps the kernel set used from now on, e.g. to compare them in a benchmark.
+inline void set_isa(isa level) { isa_override_pv() = level; }
+
+constexpr size_t small_run = 64;
+
+template <typename T> struct lanes {
+  static constexpr size_t value = sizeof(T) >= 64 ? 1 : 64 / sizeof(T);
+};
+
+namespace generic {
+
+template <typename T> RPNX_SIMD_INLINE T sum(T const *p, size_t n) {
+  constexpr size_t L = lanes<T>::value;
+  T acc[L] = {};
+  size_t i = 0;
+  for (; i + L <= n; i += L)
+    for (size_t j = 0; j != L; j++)
+      acc[j] += p[i + j];
+  T r = T();
+  for (size_t j = 0; j != L; j++)
+    r += acc[j];
+  for (; i != n; i++)
+    r += p[i];
+  return r;
+}
+
+// Requires n != 0.
+template <typename T, typename Less> RPNX_SIMD_INLINE T pick(T const *p, size_t n, Less less) {
+  constexpr size_t L = lanes<T>::value;
+  T r = p[0];
+  size_t i = 0;
+  if (n >= L) {
+    T acc[L];
+    for (size_t j = 0; j != L; j++)
+      acc[j] = p[j];
+    for (i = L; i + L <= n; i += L)
+      for (size_t j = 0; j != L; j++)
+        acc[j] = less(p[i + j], acc[j]) ? p[i + j] : acc[j];
+    for (size_t j = 0; j != L; j++)
+      r = less(acc[j], r) ? acc[j] : r;
+  }
+  for (; i != n; i++)
+    r = less(p[i], r) ? p[i] : r;
+  return r;
+}
+
+template <typename T> RPNX_SIMD_INLINE size_t count(T const *p, size_t n, T v) {
+  constexpr size_t L = lanes<T>::value;
+  // Lane counters as wide as T keep the compare and add in the same vector shape.
+  using C = typename std::conditional<sizeof(T) == 1, uint8_t,
+                                      typename std::conditional<sizeof(T) == 2, uint16_t,
+                                                                typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type>::type>::type;
+  constexpr size_t flush = std::numeric_limits<C>::max();
+  size_t r = 0;
+  size_t i = 0;
+  while (i + L <= n) {
+    C acc[L] = {};
+    for (size_t b = 0; b != flush && i + L <= n; b++, i += L)
+      for (size_t j = 0; j != L; j++)
+        acc[j] += C(p[i + j] == v);
+    for (size_t j = 0; j != L; j++)
+      r += acc[j];
+  }
+  for (; i != n; i++)
+    r += p[i] == v;
+  return r;
+}
+
+// Index of the first element matching pred, or n.
+template <typename T, typename Pred> RPNX_SIMD_INLINE size_t find_if(T const *p, size_t n, Pred &pred) {
+  constexpr size_t L = lanes<T>::value;
+  size_t i = 0;
+  for (; i + L <= n; i += L) {
+    bool any = false;
+    for (size_t j = 0; j != L; j++)
+      any |= bool(pred(p[i + j]));
+    if (any)
+      break;
+  }
+  for (; i != n; i++)
+    if (pred(p[i]))
+      return i;
+  return n;
+}
+
+template <typename T> struct less {
+  bool operator()(T a, T b) const { return a < b; }
+};
+
+template <typename T> struct greater {
+  bool operator()(T a, T b) const { return b < a; }
+};
+
+template <typename T> struct equal_to {
+  T v;
+  bool operator()(T a) const { return a == v; }
+};
+
+} // namespace generic
+
+#define RPNX_SIMD_KERNELS(ns, attr)                                                                                                        \
+  namespace ns {                                                                                                                           \
+  template <typename T> attr T sum(T const *p, size_t n) { return generic::sum(p, n); }                                                    \
+  template <typename T> attr T min(T const *p, size_t n) { return generic::pick(p, n, generic::less<T>()); }                               \
+  template <typename T> attr T max(T const *p, size_t n) { return generic::pick(p, n, generic::greater<T>()); }                            \
+  template <typename T> attr size_t count(T const *p, size_t n, T v) { return generic::count(p, n, v); }                                   \
+  template <typename T, typename Pred> attr size_t find_if(T const *p, size_t n, Pred &pred) { return generic::find_if(p, n, pred); }      \
+  }
+
+RPNX_SIMD_KERNELS(scalar_kernels, )
+#if RPNX_SIMD_X86
+RPNX_SIMD_KERNELS(sse2_kernels, __attribute__((target("sse2"))))
+RPNX_SIMD_KERNELS(avx2_kernels, __attribute__((target("avx2"))))
+RPNX_SIMD_KERNELS(avx512_kernels, __attribute__((target("avx512f,avx512bw,avx512vl"))))
+#define RPNX_SIMD_DISPATCH(level, call)                                                                                                    \
+  ((level) == isa::avx512 ? avx512_kernels::call : (level) == isa::avx2 ? avx2_kernels::call : (level) == isa::sse2 ? sse2_kernels::call   \
+                                                                                                                   : scalar_kernels::call)
+#else
+#define RPNX_SIMD_DISPATCH(level, call) scalar_kernels::call
+#endif
+
+template <typename Monoque> typename Monoque::value_type sum(Monoque const &m) {
+  using T = typename Monoque::value_type;
+  static_assert(std::is_arithmetic<T>::value, "rpnx::simd kernels require an arithmetic value_type");
+  isa level = active_isa();
+  T r = T();
+  m.for_each_segment([&](T const *p, size_t n) { r += n < small_run ? generic::sum(p, n) : RPNX_SIMD_DISPATCH(level, sum(p, n)); });
+  return r;
+}
+
+// Requires !m.empty().
+template <typename Monoque> typename Monoque::value_type min(Monoque const &m) {
+  using T = typename Monoque::value_type;
+  static_assert(std::is_arithmetic<T>::value, "rpnx::simd kernels require an arithmetic value_type");
+  isa level = active_isa();
+  T r = m[0];
+  m.for_each_segment([&](T const *p, size_t n) {
+    T x = n < small_run ? generic::pick(p, n, generic::less<T>()) : RPNX_SIMD_DISPATCH(level, min(p, n));
+    r = x < r ? x : r;
+  });
+  return r;
+}
+
+// Requires !m.empty().
+template <typename Monoque> typename Monoque::value_type max(Monoque const &m) {
+  using T = typename Monoque::value_type;
+  static_assert(std::is_arithmetic<T>::value, "rpnx::simd kernels require an arithmetic value_type");
+  isa level = active_isa();
+  T r = m[0];
+  m.for_each_segment([&](T const *p, size_t n) {
+    T x = n < small_run ? generic::pick(p, n, generic::greater<T>()) : RPNX_SIMD_DISPATCH(level, max(p, n));
+    r = r < x ? x : r;
+  });
+  return r;
+}
+
+template <typename Monoque> size_t count(Monoque const &m, typename Monoque::value_type v) {
+  using T = typename Monoque::value_type;
+  static_assert(std::is_arithmetic<T>::value, "rpnx::simd kernels require an arithmetic value_type");
+  isa level = active_isa();
+  size_t r = 0;
+  m.for_each_segment([&](T const *p, size_t n) { r += n < small_run ? generic::count(p, n, v) : RPNX_SIMD_DISPATCH(level, count(p, n, v)); });
+  return r;
+}
+
+/*
+  Index of the first element for which pred is true, or m.size(). pred is
+  evaluated on every element of a 64 byte line before the line is searched,
+  so it should be cheap and free of side effects.
+ */
+template <typename Monoque, typename Pred> size_t find_if(Monoque const &m, Pred pred) {
+  using T = typename Monoque::value_type;
+  static_assert(std::is_arithmetic<T>::value, "rpnx::simd kernels require an arithmetic value_type");
+  isa level = active_isa();
+  size_t base = 0;
+  size_t found = m.size();
+  // for_each_segment has no early exit, so once found the remaining runs are skipped cheaply.
+  m.for_each_segment([&](T const *p, size_t n) {
+    if (found != m.size())
+      return;
+    size_t i = n < small_run ? generic::find_if(p, n, pred) : RPNX_SIMD_DISPATCH(level, find_if(p, n, pred));
+    if (i != n)
+      found = base + i;
+    base += n;
+  });
+  return found;
+}
+
+template <typename Monoque> size_t find(Monoque const &m, typename Monoque::value_type v) {
+  return simd::find_if(m, generic::equal_to<typename Monoque::value_type>{v});
+}
+
+#undef RPNX_SIMD_DISPATCH
+
+} // namespace simd
+} // namespace rpnx
+
+#endif
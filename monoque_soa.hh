@@ -0,0 +1,436 @@
+/*
+Structure of Arrays Monoque
+
+Copyright (c) 2017, 2018 Ryan P. Nicholl <exaeta@protonmail.com> http://rpnx.net/
+ -- Please let me know if you find this structure useful, thanks!
+
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef RPNX_MONOQUE_SOA_HH
+#define RPNX_MONOQUE_SOA_HH
+
+#include "monoque.hh"
+#include <new>
+#include <utility>
+
+/*
+  A monoque of records stored column by column. Every field type in Ts has
+  its own set of blocks, laid out exactly like a monoque's, and all columns
+  share one size and one index computation. Appending a row is worst case
+  O(1) per column, as for monoque.
+
+    rpnx::monoque_soa<uint64_t, double, uint32_t> trades;   // id, price, venue
+    trades.emplace_back(id, price, venue);
+    double total = rpnx::simd::sum(trades.column<1>());      // reads only prices
+
+  column<I>() is a view of one field with the monoque interface the free
+  algorithms use (value_type, size, operator[], for_each_segment), so the
+  parallel and simd helpers work on single columns. Whole rows are read and
+  written through std::tuple<Ts &...> proxies from operator[] and the
+  iterators.
+
+  basic_monoque_soa takes the allocator first, since the fields are a pack;
+  it is rebound to each field type through allocator_traits, so a pmr
+  allocator reaches every column and every allocator-aware field.
+  monoque_soa<Ts...> uses std::allocator and rpnx::pmr::monoque_soa<Ts...> a
+  polymorphic_allocator.
+ */
+
+namespace rpnx {
+template <typename Allocator, typename... Ts> class basic_monoque_soa : private Allocator {
+public:
+  using layout = monoque_layout;
+  using allocator_type = Allocator;
+  using value_type = std::tuple<Ts...>;
+  using reference = std::tuple<Ts &...>;
+  using const_reference = std::tuple<Ts const &...>;
+  using size_type = size_t;
+  static constexpr size_t columns = sizeof...(Ts);
+
+  // One field of every row, viewed as a monoque.
+  template <typename U> class basic_column {
+    friend class basic_monoque_soa;
+    using table = typename std::remove_const<U>::type *const *;
+
+    table table_pv;
+    size_t size_pv;
+
+    basic_column(table t, size_t n) : table_pv(t), size_pv(n) {}
+
+  public:
+    using value_type = typename std::remove_const<U>::type;
+    using layout = monoque_layout;
+    using segment_type = typename monoque<value_type>::template basic_segment<U>;
+
+    size_type size() const { return size_pv; }
+    bool empty() const { return size_pv == 0; }
+    size_type segment_count() const { return layout::segment_count(size_pv); }
+
+    segment_type segment(size_type k) const { return segment_type(table_pv[k], std::min(layout::segment_capacity(k), size_pv - layout::segment_begin(k))); }
+
+    U &operator[](size_t i) const {
+      using namespace std;
+      size_t k, o;
+      tie(k, o) = layout::index(i);
+      return table_pv[k][o];
+    }
+
+    // Calls f(U *data, size_t n) once per contiguous run, in order, covering [first, last).
+    template <typename F> void for_each_segment(size_t first, size_t last, F &&f) const {
+      using namespace std;
+      if (first >= last)
+        return;
+      size_t k, off;
+      tie(k, off) = layout::index(first);
+      while (first < last) {
+        size_t n = std::min(layout::segment_capacity(k) - off, last - first);
+        f(static_cast<U *>(table_pv[k] + off), n);
+        first += n;
+        k++;
+        off = 0;
+      }
+    }
+
+    template <typename F> void for_each_segment(F &&f) const { for_each_segment(0, size_pv, f); }
+  };
+
+  template <size_t I> using column_type = basic_column<typename std::tuple_element<I, value_type>::type>;
+  template <size_t I> using const_column_type = basic_column<typename std::tuple_element<I, value_type>::type const>;
+
+private:
+  using traits_pv = std::allocator_traits<Allocator>;
+  template <typename U> using table_pv = std::array<U *, layout::max_segments>;
+
+  std::tuple<table_pv<Ts>...> tables_pv;
+  size_t size_pv;
+
+  template <size_t I> using field_pv = typename std::tuple_element<I, value_type>::type;
+  template <size_t I> using field_alloc_pv = typename traits_pv::template rebind_alloc<field_pv<I>>;
+  template <size_t I> using field_traits_pv = std::allocator_traits<field_alloc_pv<I>>;
+
+  Allocator &alloc_pv() { return *this; }
+  template <size_t I> field_alloc_pv<I> field_allocator_pv() { return field_alloc_pv<I>(alloc_pv()); }
+
+  template <size_t I> field_pv<I> *slot_pv(size_t k, size_t o) const { return std::get<I>(tables_pv)[k] + o; }
+
+  /*
+    Allocates block k of columns I and up, and installs them only once every allocation has
+    succeeded, so block k is either present in every column or in none.
+   */
+  template <size_t I> void open_block_pv(size_t k) {
+    if constexpr (I < columns) {
+      field_alloc_pv<I> a = field_allocator_pv<I>();
+      size_t n = layout::segment_capacity(k);
+      field_pv<I> *p = field_traits_pv<I>::allocate(a, n);
+      try {
+        open_block_pv<I + 1>(k);
+      } catch (...) {
+        field_traits_pv<I>::deallocate(a, p, n);
+        throw;
+      }
+      std::get<I>(tables_pv)[k] = p;
+    }
+  }
+
+  template <size_t I> void free_column_pv() {
+    field_alloc_pv<I> a = field_allocator_pv<I>();
+    for (size_t k = 0; k != layout::max_segments; k++)
+      if (std::get<I>(tables_pv)[k] != nullptr) {
+        field_traits_pv<I>::deallocate(a, std::get<I>(tables_pv)[k], layout::segment_capacity(k));
+        std::get<I>(tables_pv)[k] = nullptr;
+      }
+  }
+
+  template <size_t... I> void free_blocks_pv(std::index_sequence<I...>) { (free_column_pv<I>(), ...); }
+
+  // Constructs the fields of row (k, o) from the elements of t, unwinding the columns already built if one throws.
+  template <size_t I, typename Tuple> void construct_pv(size_t k, size_t o, Tuple &&t) {
+    if constexpr (I < columns) {
+      field_alloc_pv<I> a = field_allocator_pv<I>();
+      field_traits_pv<I>::construct(a, slot_pv<I>(k, o), std::get<I>(std::forward<Tuple>(t)));
+      try {
+        construct_pv<I + 1>(k, o, std::forward<Tuple>(t));
+      } catch (...) {
+        field_traits_pv<I>::destroy(a, slot_pv<I>(k, o));
+        throw;
+      }
+    }
+  }
+
+  template <size_t I> void destroy_field_pv(size_t k, size_t o) {
+    field_alloc_pv<I> a = field_allocator_pv<I>();
+    field_traits_pv<I>::destroy(a, slot_pv<I>(k, o));
+  }
+
+  template <size_t... I> void destroy_pv(size_t k, size_t o, std::index_sequence<I...>) { (destroy_field_pv<I>(k, o), ...); }
+
+  // Destroys column I's elements in [0, n).
+  template <size_t I> void destroy_column_pv(size_t n) {
+    if (!std::is_trivially_destructible<field_pv<I>>::value)
+      for (size_t i = 0; i != n; i++)
+        destroy_field_pv<I>(layout::index1(i), layout::index2(i));
+  }
+
+  /*
+    Copies column I and the ones after it from other, one block at a time (memcpy for trivially
+    copyable fields). If a copy throws, every element copied so far, in any column, is destroyed.
+   */
+  template <size_t I> void copy_columns_pv(basic_monoque_soa const &other) {
+    if constexpr (I < columns) {
+      using U = field_pv<I>;
+      field_alloc_pv<I> a = field_allocator_pv<I>();
+      size_t done = 0;
+      try {
+        other.template column<I>().for_each_segment([&](U const *src, size_t n) {
+          size_t k = layout::index1(done);
+          U *dst = std::get<I>(tables_pv)[k];
+          if (std::is_trivially_copyable<U>::value) {
+            memcpy(static_cast<void *>(dst), src, n * sizeof(U));
+            done += n;
+          } else
+            for (size_t i = 0; i != n; i++, done++)
+              field_traits_pv<I>::construct(a, dst + i, src[i]);
+        });
+        copy_columns_pv<I + 1>(other);
+      } catch (...) {
+        destroy_column_pv<I>(done);
+        throw;
+      }
+    }
+  }
+
+  template <size_t... I> reference row_pv(size_t k, size_t o, std::index_sequence<I...>) const { return reference(*slot_pv<I>(k, o)...); }
+
+  template <size_t... I> void append_moved_row_pv(basic_monoque_soa &other, size_t i, std::index_sequence<I...>) {
+    using namespace std;
+    size_t k, o;
+    tie(k, o) = layout::index(i);
+    append_row_pv(std::forward_as_tuple(std::move(*other.template slot_pv<I>(k, o))...));
+  }
+
+  template <typename Tuple> void append_row_pv(Tuple &&t) {
+    using namespace std;
+    size_t k, o;
+    tie(k, o) = layout::index(size_pv);
+    // Blocks are opened for all columns at once, so column 0 speaks for every column.
+    if (rpnx_unlikely(std::get<0>(tables_pv)[k] == nullptr))
+      open_block_pv<0>(k);
+    construct_pv<0>(k, o, std::forward<Tuple>(t));
+    size_pv++;
+  }
+
+  template <bool SwapAllocators> void swap_pv(basic_monoque_soa &other) {
+    if constexpr (SwapAllocators) {
+      using std::swap;
+      swap(alloc_pv(), other.alloc_pv());
+    }
+    std::swap(tables_pv, other.tables_pv);
+    std::swap(size_pv, other.size_pv);
+  }
+
+public:
+  template <bool Const> class basic_iterator {
+    friend class basic_monoque_soa;
+    template <bool> friend class basic_iterator;
+    using owner = typename std::conditional<Const, basic_monoque_soa const, basic_monoque_soa>::type;
+
+    owner *m_pv;
+    size_t i_pv;
+
+    basic_iterator(owner *m, size_t i) : m_pv(m), i_pv(i) {}
+
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = typename basic_monoque_soa::value_type;
+    using difference_type = ptrdiff_t;
+    using reference = typename std::conditional<Const, const_reference, typename basic_monoque_soa::reference>::type;
+    using pointer = void;
+
+    basic_iterator() : m_pv(nullptr), i_pv(0) {}
+    // iterator converts to const_iterator.
+    template <bool C, typename = typename std::enable_if<Const && !C>::type> basic_iterator(basic_iterator<C> const &o) : m_pv(o.m_pv), i_pv(o.i_pv) {}
+
+    reference operator*() const { return (*m_pv)[i_pv]; }
+    reference operator[](difference_type n) const { return (*m_pv)[i_pv + n]; }
+
+    basic_iterator &operator++() {
+      i_pv++;
+      return *this;
+    }
+    basic_iterator operator++(int) {
+      basic_iterator r = *this;
+      i_pv++;
+      return r;
+    }
+    basic_iterator &operator--() {
+      i_pv--;
+      return *this;
+    }
+    basic_iterator operator--(int) {
+      basic_iterator r = *this;
+      i_pv--;
+      return r;
+    }
+    basic_iterator &operator+=(difference_type n) {
+      i_pv += n;
+      return *this;
+    }
+    basic_iterator &operator-=(difference_type n) {
+      i_pv -= n;
+      return *this;
+    }
+    basic_iterator operator+(difference_type n) const { return basic_iterator(m_pv, i_pv + n); }
+    basic_iterator operator-(difference_type n) const { return basic_iterator(m_pv, i_pv - n); }
+    difference_type operator-(basic_iterator const &o) const { return difference_type(i_pv - o.i_pv); }
+
+    bool operator==(basic_iterator const &o) const { return i_pv == o.i_pv; }
+    bool operator!=(basic_iterator const &o) const { return i_pv != o.i_pv; }
+    bool operator<(basic_iterator const &o) const { return i_pv < o.i_pv; }
+    bool operator<=(basic_iterator const &o) const { return i_pv <= o.i_pv; }
+    bool operator>(basic_iterator const &o) const { return i_pv > o.i_pv; }
+    bool operator>=(basic_iterator const &o) const { return i_pv >= o.i_pv; }
+  };
+
+  using iterator = basic_iterator<false>;
+  using const_iterator = basic_iterator<true>;
+
+  basic_monoque_soa() : basic_monoque_soa(Allocator()) {}
+
+  explicit basic_monoque_soa(Allocator const &alloc) : Allocator(alloc), size_pv(0) {
+    std::apply([](auto &... t) { (t.fill(nullptr), ...); }, tables_pv);
+  }
+
+  basic_monoque_soa(basic_monoque_soa const &other) : basic_monoque_soa(other, traits_pv::select_on_container_copy_construction(other.get_allocator())) {}
+
+  basic_monoque_soa(basic_monoque_soa const &other, Allocator const &alloc) : basic_monoque_soa(alloc) {
+    for (size_t k = 0, e = other.segment_count(); k != e; k++)
+      open_block_pv<0>(k);
+    copy_columns_pv<0>(other);
+    size_pv = other.size_pv;
+  }
+
+  basic_monoque_soa(basic_monoque_soa &&other) : basic_monoque_soa(other.get_allocator()) { swap_pv<false>(other); }
+
+  basic_monoque_soa &operator=(basic_monoque_soa const &other) {
+    constexpr bool propagate = traits_pv::propagate_on_container_copy_assignment::value;
+    if (this != &other) {
+      basic_monoque_soa copy(other, propagate ? other.get_allocator() : get_allocator());
+      swap_pv<propagate>(copy);
+    }
+    return *this;
+  }
+
+  // Takes other's blocks when the allocator propagates or compares equal; otherwise moves the rows one by one.
+  basic_monoque_soa &operator=(basic_monoque_soa &&other) {
+    constexpr bool propagate = traits_pv::propagate_on_container_move_assignment::value;
+    if (propagate || traits_pv::is_always_equal::value || get_allocator() == other.get_allocator()) {
+      swap_pv<propagate>(other);
+    } else {
+      basic_monoque_soa moved(get_allocator());
+      for (size_t i = 0; i != other.size_pv; i++)
+        moved.append_moved_row_pv(other, i, std::index_sequence_for<Ts...>());
+      swap_pv<false>(moved);
+    }
+    return *this;
+  }
+
+  ~basic_monoque_soa() {
+    clear();
+    free_blocks_pv(std::index_sequence_for<Ts...>());
+  }
+
+  allocator_type const &get_allocator() const { return *this; }
+
+  size_type size() const { return size_pv; }
+  bool empty() const { return size_pv == 0; }
+  size_type segment_count() const { return layout::segment_count(size_pv); }
+
+  reference operator[](size_t i) {
+    using namespace std;
+    size_t k, o;
+    tie(k, o) = layout::index(i);
+    return row_pv(k, o, std::index_sequence_for<Ts...>());
+  }
+
+  const_reference operator[](size_t i) const {
+    using namespace std;
+    size_t k, o;
+    tie(k, o) = layout::index(i);
+    return row_pv(k, o, std::index_sequence_for<Ts...>());
+  }
+
+  reference back() { return (*this)[size_pv - 1]; }
+  const_reference back() const { return (*this)[size_pv - 1]; }
+
+  void push_back(value_type const &row) { append_row_pv(row); }
+  void push_back(value_type &&row) { append_row_pv(std::move(row)); }
+
+  // One constructor argument per column.
+  template <typename... Us> void emplace_back(Us &&... us) {
+    static_assert(sizeof...(Us) == columns, "emplace_back takes one argument per column");
+    append_row_pv(std::forward_as_tuple(std::forward<Us>(us)...));
+  }
+
+  void pop_back() {
+    using namespace std;
+    assert(size_pv != 0);
+    size_t k, o;
+    tie(k, o) = layout::index(size_pv - 1);
+    destroy_pv(k, o, std::index_sequence_for<Ts...>());
+    size_pv--;
+  }
+
+  // Destroys every row but keeps the blocks, like monoque::clear().
+  void clear() {
+    while (size_pv != 0)
+      pop_back();
+  }
+
+  template <size_t I> column_type<I> column() { return column_type<I>(std::get<I>(tables_pv).data(), size_pv); }
+  template <size_t I> const_column_type<I> column() const { return const_column_type<I>(std::get<I>(tables_pv).data(), size_pv); }
+
+  iterator begin() { return iterator(this, 0); }
+  iterator end() { return iterator(this, size_pv); }
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, size_pv); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+  // Like monoque::swap: allocators are exchanged only if they propagate on swap, and must otherwise compare equal.
+  void swap(basic_monoque_soa &other) {
+    assert(traits_pv::propagate_on_container_swap::value || get_allocator() == other.get_allocator());
+    swap_pv<traits_pv::propagate_on_container_swap::value>(other);
+  }
+
+  friend void swap(basic_monoque_soa &a, basic_monoque_soa &b) { a.swap(b); }
+};
+
+template <typename... Ts> using monoque_soa = basic_monoque_soa<std::allocator<char>, Ts...>;
+
+#if __has_include(<memory_resource>)
+namespace pmr {
+// A monoque_soa whose columns, and allocator-aware fields, allocate from a std::pmr::memory_resource.
+template <typename... Ts> using monoque_soa = basic_monoque_soa<std::pmr::polymorphic_allocator<char>, Ts...>;
+} // namespace pmr
+#endif
+} // namespace rpnx
+
+#endif
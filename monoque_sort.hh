@@ -0,0 +1,386 @@
+/*
+Monoque Sorting
+
+Copyright (c) 2017, 2018 Ryan P. Nicholl <exaeta@protonmail.com> http://rpnx.net/
+ -- Please let me know if you find this structure useful, thanks!
+
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef RPNX_MONOQUE_SORT_HH
+#define RPNX_MONOQUE_SORT_HH
+
+#include "monoque.hh"
+#include "monoque_parallel.hh"
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/*
+  Sorting without the index-based iterator.
+
+  rpnx::sort(m, comp) cuts m into runs that never cross a block, sorts the
+  runs in place in parallel with std::sort on plain pointers, moves them into
+  uninitialized scratch storage from m's allocator, and merges all of them
+  back into m in a single multiway pass. The merge is cut into pieces by
+  sampled splitter values, so it runs in parallel too. Memory is crossed
+  twice after the run sorts, whatever the number of runs. The result is not
+  stable; T must be move constructible and move assignable.
+
+  rpnx::radix_sort(m) is a stable LSD radix sort, one byte per pass, for keys
+  with a radix_key specialization: integral types other than bool and
+  std::pair of such keys, ordered like operator<. Passes in which every
+  element has the same byte are skipped. rpnx::sort(m) uses it whenever the
+  value type has a radix key and std::sort otherwise.
+ */
+
+namespace rpnx {
+
+template <typename T, typename = void> struct radix_key {
+  static constexpr bool enabled = false;
+};
+
+template <typename T> struct radix_key<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> {
+  using U = typename std::make_unsigned<T>::type;
+  static constexpr bool enabled = true;
+  static constexpr size_t bytes = sizeof(T);
+  // Flipping the sign bit makes signed keys order like their unsigned images.
+  static constexpr U flip = std::is_signed<T>::value ? U(U(1) << (sizeof(T) * 8 - 1)) : U(0);
+  static uint8_t digit(T v, size_t i) { return uint8_t((U(v) ^ flip) >> (8 * i)); }
+};
+
+// Byte i counts from the least significant end: first the bytes of second, then those of first.
+template <typename A, typename B> struct radix_key<std::pair<A, B>, typename std::enable_if<radix_key<A>::enabled && radix_key<B>::enabled>::type> {
+  static constexpr bool enabled = true;
+  static constexpr size_t bytes = radix_key<A>::bytes + radix_key<B>::bytes;
+  static uint8_t digit(std::pair<A, B> const &v, size_t i) {
+    return i < radix_key<B>::bytes ? radix_key<B>::digit(v.second, i) : radix_key<A>::digit(v.first, i - radix_key<B>::bytes);
+  }
+};
+
+// Walks a monoque from an index on, reloading the block pointer only at block ends.
+template <typename Monoque> class segment_cursor_pv {
+  using layout = typename Monoque::layout;
+
+  Monoque *m_pv;
+  typename Monoque::value_type *p_pv;
+  typename Monoque::value_type *end_pv;
+  size_t pos_pv;
+
+  void seek_pv() {
+    if (pos_pv >= m_pv->size())
+      return;
+    size_t k = layout::index1(pos_pv);
+    p_pv = &(*m_pv)[pos_pv];
+    end_pv = p_pv + (layout::segment_begin(k) + layout::segment_capacity(k) - pos_pv);
+  }
+
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = typename Monoque::value_type;
+  using difference_type = ptrdiff_t;
+  using pointer = value_type *;
+  using reference = value_type &;
+
+  segment_cursor_pv() : m_pv(nullptr), p_pv(nullptr), end_pv(nullptr), pos_pv(0) {}
+  segment_cursor_pv(Monoque &m, size_t pos) : m_pv(&m), p_pv(nullptr), end_pv(nullptr), pos_pv(pos) { seek_pv(); }
+
+  reference operator*() const { return *p_pv; }
+  pointer operator->() const { return p_pv; }
+
+  segment_cursor_pv &operator++() {
+    ++pos_pv;
+    if (++p_pv == end_pv)
+      seek_pv();
+    return *this;
+  }
+
+  segment_cursor_pv operator++(int) {
+    segment_cursor_pv r = *this;
+    ++*this;
+    return r;
+  }
+
+  bool operator==(segment_cursor_pv const &o) const { return pos_pv == o.pos_pv; }
+  bool operator!=(segment_cursor_pv const &o) const { return pos_pv != o.pos_pv; }
+};
+
+// The two sides of the sort ping-pong, both addressed by element index.
+template <typename Monoque> struct monoque_side_pv {
+  using value_type = typename Monoque::value_type;
+  Monoque &m;
+
+  value_type &at(size_t i) const { return m[i]; }
+  segment_cursor_pv<Monoque> cursor(size_t i) const { return segment_cursor_pv<Monoque>(m, i); }
+  template <typename F> void for_each_segment(size_t first, size_t last, F f) const { m.for_each_segment(first, last, f); }
+};
+
+template <typename T> struct buffer_side_pv {
+  using value_type = T;
+  T *p;
+
+  T &at(size_t i) const { return p[i]; }
+  T *cursor(size_t i) const { return p + i; }
+  template <typename F> void for_each_segment(size_t first, size_t last, F f) const {
+    if (first < last)
+      f(p + first, last - first);
+  }
+};
+
+// Uninitialized scratch storage from the container's allocator, one slot per element of m.
+template <typename Monoque> class sort_scratch_pv {
+  using T = typename Monoque::value_type;
+  using alloc_type = typename std::allocator_traits<typename Monoque::allocator_type>::template rebind_alloc<T>;
+  using traits = std::allocator_traits<alloc_type>;
+
+  alloc_type a_pv;
+  typename traits::pointer p_pv;
+  size_t n_pv;
+  std::vector<size_t> const &bounds_pv;
+  std::vector<unsigned char> built_pv;
+
+public:
+  sort_scratch_pv(Monoque &m, std::vector<size_t> const &bounds)
+      : a_pv(m.get_allocator()), p_pv(traits::allocate(a_pv, m.size())), n_pv(m.size()), bounds_pv(bounds), built_pv(bounds.size() - 1, 0) {}
+  sort_scratch_pv(sort_scratch_pv const &) = delete;
+  sort_scratch_pv &operator=(sort_scratch_pv const &) = delete;
+
+  // Destroys the runs that were moved in, then releases the storage.
+  ~sort_scratch_pv() {
+    for (size_t r = 0; r != built_pv.size(); r++)
+      if (built_pv[r])
+        std::destroy(data() + bounds_pv[r], data() + bounds_pv[r + 1]);
+    traits::deallocate(a_pv, p_pv, n_pv);
+  }
+
+  T *data() const { return &*p_pv; }
+
+  // Move-constructs run r of m into the matching slots; called at most once per run.
+  void take_run(Monoque &m, size_t r) {
+    T *p = &m[bounds_pv[r]];
+    std::uninitialized_move(p, p + (bounds_pv[r + 1] - bounds_pv[r]), data() + bounds_pv[r]);
+    built_pv[r] = 1;
+  }
+};
+
+// Restores the min-heap property, by below, for the subtree of h rooted at i.
+template <typename H, typename Below> void sift_down_pv(H *h, size_t i, size_t n, Below &below) {
+  H v = h[i];
+  for (size_t c; (c = 2 * i + 1) < n; i = c) {
+    if (c + 1 < n && below(h[c + 1], h[c]))
+      c++;
+    if (!below(h[c], v))
+      break;
+    h[i] = h[c];
+  }
+  h[i] = v;
+}
+
+/*
+  Merges the sorted ranges heads[r] = (first, last) into m from index out on, with a binary
+  heap of range heads. Each output costs one sift-down, i.e. about 2 log2(ranges) comparisons.
+ */
+template <typename Monoque, typename T, typename Compare>
+void multiway_merge_pv(Monoque &m, size_t out, std::vector<std::pair<T *, T *>> &heads, Compare &comp) {
+  auto below = [&](std::pair<T *, T *> const &a, std::pair<T *, T *> const &b) { return comp(*a.first, *b.first); };
+  heads.erase(std::remove_if(heads.begin(), heads.end(), [](std::pair<T *, T *> const &h) { return h.first == h.second; }), heads.end());
+  size_t n = heads.size();
+  for (size_t i = n / 2; i-- != 0;)
+    sift_down_pv(heads.data(), i, n, below);
+
+  segment_cursor_pv<Monoque> dst(m, out);
+  while (n > 1) {
+    std::pair<T *, T *> &top = heads[0];
+    *dst = std::move(*top.first);
+    ++dst;
+    if (++top.first == top.second)
+      top = heads[--n];
+    sift_down_pv(heads.data(), 0, n, below);
+  }
+  if (n == 1)
+    std::move(heads[0].first, heads[0].second, dst);
+}
+
+template <typename Monoque, typename Compare> void sort(Monoque &m, Compare comp, parallel::thread_pool &pool = parallel::default_pool()) {
+  using T = typename Monoque::value_type;
+  size_t size = m.size();
+  if (size < 2)
+    return;
+
+  // Runs of at most run_len elements that never cross a block.
+  size_t run_len = std::max(size_t(1024), size / (pool.concurrency() * 4) + 1);
+  std::vector<size_t> bounds;
+  m.for_each_segment([&](T *, size_t n) {
+    size_t first = bounds.empty() ? 0 : bounds.back();
+    size_t count = (n + run_len - 1) / run_len;
+    if (bounds.empty())
+      bounds.push_back(0);
+    for (size_t j = 1; j <= count; j++)
+      bounds.push_back(first + n * j / count);
+  });
+  size_t runs = bounds.size() - 1;
+
+  if (runs == 1) {
+    std::sort(&m[0], &m[0] + size, comp);
+    return;
+  }
+
+  // Each run is sorted and then moved out while it is still in cache, leaving m free to receive the merge.
+  sort_scratch_pv<Monoque> scratch(m, bounds);
+  T *src = scratch.data();
+  pool.run(runs, [&](size_t r) {
+    T *p = &m[bounds[r]];
+    std::sort(p, p + (bounds[r + 1] - bounds[r]), comp);
+    scratch.take_run(m, r);
+  });
+
+  /*
+    One merge of all runs, cut into pieces by splitter values drawn from a regular sample of the runs.
+    Piece j takes, from every run, the elements not below splitter j - 1 and below splitter j, so
+    pieces are independent and land at the prefix sums of their sizes. Long runs of equal keys can
+    make one piece larger than the others, but never break the order.
+   */
+  size_t pieces = std::max(size_t(1), std::min(pool.concurrency() * 4, size / parallel::min_chunk));
+  std::vector<T const *> sample;
+  for (size_t r = 0; r != runs && pieces > 1; r++) {
+    size_t len = bounds[r + 1] - bounds[r], s = pieces * 8 * len / size + 1;
+    for (size_t j = 0; j != s; j++)
+      sample.push_back(src + bounds[r] + len * (2 * j + 1) / (2 * s));
+  }
+  std::sort(sample.begin(), sample.end(), [&](T const *a, T const *b) { return comp(*a, *b); });
+
+  // cut[j * runs + r] is where piece j starts within run r.
+  std::vector<T *> cut((pieces + 1) * runs);
+  pool.run(pieces + 1, [&](size_t j) {
+    for (size_t r = 0; r != runs; r++) {
+      T *first = src + bounds[r], *last = src + bounds[r + 1];
+      cut[j * runs + r] = j == 0 ? first : j == pieces ? last : std::lower_bound(first, last, *sample[sample.size() * j / pieces], comp);
+    }
+  });
+
+  std::vector<size_t> out(pieces + 1, 0);
+  for (size_t j = 0; j != pieces; j++) {
+    out[j + 1] = out[j];
+    for (size_t r = 0; r != runs; r++)
+      out[j + 1] += size_t(cut[(j + 1) * runs + r] - cut[j * runs + r]);
+  }
+
+  pool.run(pieces, [&](size_t j) {
+    std::vector<std::pair<T *, T *>> heads(runs);
+    for (size_t r = 0; r != runs; r++)
+      heads[r] = std::make_pair(cut[j * runs + r], cut[(j + 1) * runs + r]);
+    multiway_merge_pv(m, out[j], heads, comp);
+  });
+}
+
+// Stable LSD radix sort by radix_key<value_type>.
+template <typename Monoque> void radix_sort(Monoque &m, parallel::thread_pool &pool = parallel::default_pool()) {
+  using T = typename Monoque::value_type;
+  using key = radix_key<T>;
+  static_assert(key::enabled, "radix_sort requires a value_type with a radix_key");
+
+  size_t size = m.size();
+  if (size < 2)
+    return;
+
+  size_t chunks = std::max(size_t(1), std::min(pool.concurrency() * 4, size / parallel::min_chunk));
+  std::vector<T> scratch(size);
+  std::vector<std::array<size_t, 256>> offsets(chunks);
+  monoque_side_pv<Monoque> in_place{m};
+  buffer_side_pv<T> buffer{scratch.data()};
+  bool in_buffer = false;
+
+  auto pass = [&](auto const &src, auto const &dst, size_t byte) {
+    using Cursor = decltype(dst.cursor(0));
+    pool.run(chunks, [&](size_t c) {
+      std::array<size_t, 256> &h = offsets[c];
+      h.fill(0);
+      src.for_each_segment(size * c / chunks, size * (c + 1) / chunks, [&](T const *p, size_t n) {
+        for (size_t i = 0; i != n; i++)
+          h[key::digit(p[i], byte)]++;
+      });
+    });
+
+    // Exclusive prefix sums in (digit, chunk) order turn the histograms into each chunk's first output index per digit.
+    size_t at = 0;
+    for (size_t d = 0; d != 256; d++) {
+      size_t n = 0;
+      for (size_t c = 0; c != chunks; c++)
+        n += offsets[c][d];
+      if (n == size)
+        return false;
+    }
+    for (size_t d = 0; d != 256; d++) {
+      for (size_t c = 0; c != chunks; c++) {
+        size_t n = offsets[c][d];
+        offsets[c][d] = at;
+        at += n;
+      }
+    }
+
+    pool.run(chunks, [&](size_t c) {
+      std::array<Cursor, 256> out;
+      std::array<bool, 256> opened;
+      opened.fill(false);
+      src.for_each_segment(size * c / chunks, size * (c + 1) / chunks, [&](T *p, size_t n) {
+        for (size_t i = 0; i != n; i++) {
+          uint8_t d = key::digit(p[i], byte);
+          if (rpnx_unlikely(!opened[d])) {
+            out[d] = dst.cursor(offsets[c][d]);
+            opened[d] = true;
+          }
+          *out[d] = std::move(p[i]);
+          ++out[d];
+        }
+      });
+    });
+    return true;
+  };
+
+  for (size_t byte = 0; byte != key::bytes; byte++) {
+    if (in_buffer ? pass(buffer, in_place, byte) : pass(in_place, buffer, byte))
+      in_buffer = !in_buffer;
+  }
+
+  if (in_buffer)
+    parallel::for_each_chunk(size,
+                             [&](size_t first, size_t last) {
+                               m.for_each_segment(first, last, [&](T *p, size_t n) {
+                                 std::move(scratch.data() + first, scratch.data() + first + n, p);
+                                 first += n;
+                               });
+                             },
+                             pool);
+}
+
+template <typename Monoque, typename T = typename Monoque::value_type> typename std::enable_if<radix_key<T>::enabled>::type sort(Monoque &m) {
+  rpnx::radix_sort(m);
+}
+
+template <typename Monoque, typename T = typename Monoque::value_type> typename std::enable_if<!radix_key<T>::enabled>::type sort(Monoque &m) {
+  rpnx::sort(m, std::less<T>());
+}
+
+} // namespace rpnx
+
+#endif
@@ -0,0 +1,155 @@
+/*
+Monoque Statistics
+
+Copyright (c) 2017, 2018 Ryan P. Nicholl <exaeta@protonmail.com> http://rpnx.net/
+ -- Please let me know if you find this structure useful, thanks!
+
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef RPNX_MONOQUE_STATS_HH
+#define RPNX_MONOQUE_STATS_HH
+
+#include "monoque.hh"
+#include <atomic>
+#include <chrono>
+
+/*
+  A Stats policy for monoque that counts block allocations and frees, the
+  peak number of blocks and bytes held, and the time spent inside
+  Allocator::allocate (nearly all of it on the push_back or emplace_back that
+  opens a block). With AccessSampleRate = N, a power of two, every Nth
+  operator[] access is also counted against the block it lands in.
+
+    rpnx::monoque<order, std::allocator<order>, 2, false, rpnx::counting_monoque_stats<>> book;
+    ...
+    rpnx::monoque_stats_snapshot s = book.stats();
+    export_gauge("book.slack_bytes", s.bytes_reserved - s.bytes_used);
+
+  The block counters change only with the container, so like it they are
+  not synchronized. The access samples are taken from const operator[],
+  which several threads may call at once (the monoque_parallel algorithms
+  do), so they are relaxed atomics; the sampling tick is a plain relaxed
+  load and store, so racing readers may share or skip a sample, but never
+  race. A copy starts from zero; a move or swap carries the counters along
+  with the blocks.
+ */
+
+namespace rpnx {
+// The access samples of counting_monoque_stats; with AccessSampleRate = 0 it is empty and adds no bytes.
+template <size_t AccessSampleRate> class monoque_access_samples_pv {
+  mutable std::atomic<uint64_t> tick_pv{0};
+  mutable std::array<std::atomic<uint64_t>, sizeof(void *) * 8> access_pv{};
+
+public:
+  monoque_access_samples_pv() {}
+  monoque_access_samples_pv(monoque_access_samples_pv const &) {}
+  monoque_access_samples_pv &operator=(monoque_access_samples_pv const &) { return *this; }
+  monoque_access_samples_pv(monoque_access_samples_pv &&other) { *this = std::move(other); }
+  monoque_access_samples_pv &operator=(monoque_access_samples_pv &&other) {
+    tick_pv.store(other.tick_pv.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    for (size_t k = 0; k != access_pv.size(); k++)
+      access_pv[k].store(other.access_pv[k].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    return *this;
+  }
+
+  void on_access(size_t k) const {
+    uint64_t t = tick_pv.load(std::memory_order_relaxed);
+    tick_pv.store(t + 1, std::memory_order_relaxed);
+    if ((t & (AccessSampleRate - 1)) == 0)
+      access_pv[k].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void fill(monoque_stats_snapshot &s) const {
+    for (size_t k = 0; k != access_pv.size(); k++)
+      s.access_samples[k] = access_pv[k].load(std::memory_order_relaxed);
+  }
+};
+
+template <> class monoque_access_samples_pv<0> {
+public:
+  void on_access(size_t) const {}
+  void fill(monoque_stats_snapshot &) const {}
+};
+
+template <size_t AccessSampleRate = 0> class counting_monoque_stats : private monoque_access_samples_pv<AccessSampleRate> {
+  static_assert((AccessSampleRate & (AccessSampleRate - 1)) == 0, "AccessSampleRate must be 0 or a power of two");
+  using samples_pv = monoque_access_samples_pv<AccessSampleRate>;
+
+  uint64_t allocations_pv = 0;
+  uint64_t frees_pv = 0;
+  uint64_t live_pv = 0;
+  uint64_t peak_pv = 0;
+  uint64_t bytes_pv = 0;
+  uint64_t peak_bytes_pv = 0;
+  uint64_t ns_pv = 0;
+  uint64_t max_ns_pv = 0;
+
+public:
+  counting_monoque_stats() {}
+  counting_monoque_stats(counting_monoque_stats const &) {}
+  counting_monoque_stats &operator=(counting_monoque_stats const &) { return *this; }
+  counting_monoque_stats(counting_monoque_stats &&other) : samples_pv() { *this = std::move(other); }
+  counting_monoque_stats &operator=(counting_monoque_stats &&other) {
+    samples_pv::operator=(std::move(other));
+    allocations_pv = other.allocations_pv;
+    frees_pv = other.frees_pv;
+    live_pv = other.live_pv;
+    peak_pv = other.peak_pv;
+    bytes_pv = other.bytes_pv;
+    peak_bytes_pv = other.peak_bytes_pv;
+    ns_pv = other.ns_pv;
+    max_ns_pv = other.max_ns_pv;
+    return *this;
+  }
+
+  template <typename F> auto on_block_allocate(size_t, size_t bytes, F &&allocate) -> decltype(allocate()) {
+    auto start = std::chrono::steady_clock::now();
+    auto p = allocate();
+    uint64_t ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    ns_pv += ns;
+    max_ns_pv = std::max(max_ns_pv, ns);
+    allocations_pv++;
+    peak_pv = std::max(peak_pv, ++live_pv);
+    peak_bytes_pv = std::max(peak_bytes_pv, bytes_pv += bytes);
+    return p;
+  }
+
+  void on_block_free(size_t, size_t bytes) {
+    frees_pv++;
+    live_pv--;
+    bytes_pv -= bytes;
+  }
+
+  using samples_pv::on_access;
+
+  void fill(monoque_stats_snapshot &s) const {
+    s.segment_allocations = allocations_pv;
+    s.segment_frees = frees_pv;
+    s.peak_segments = peak_pv;
+    s.peak_bytes_reserved = peak_bytes_pv;
+    s.allocate_ns = ns_pv;
+    s.max_allocate_ns = max_ns_pv;
+    samples_pv::fill(s);
+  }
+};
+} // namespace rpnx
+
+#endif
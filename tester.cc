@@ -1,8 +1,31 @@
 #include "monoque.hh"
+#include "concurrent_monoque.hh"
+#include "monodeque.hh"
+#include "mapped_monoque.hh"
+#include "monoque_io.hh"
+#include "monoque_parallel.hh"
+#include "monoque_simd.hh"
+#include "monoque_cache.hh"
+#include "monoque_hugepage.hh"
+#include "monoque_sort.hh"
+#include "monoque_heap.hh"
+#include "monoque_stats.hh"
+#include "monoque_queue.hh"
+#include "bit_monoque.hh"
+#include "monoque_soa.hh"
+#include "compact_monoque.hh"
 #include <algorithm>
 #include <assert.h>
+#include <deque>
+#include <fcntl.h>
 #include <iostream>
+#include <iterator>
+#include <list>
+#include <numeric>
 #include <queue>
+#include <sstream>
+#include <sys/stat.h>
+#include <thread>
 #include <vector>
 
 class tester {
@@ -39,6 +62,17 @@ public:
 
 size_t tester::dval = 0;
 
+// An allocator whose construct() has an effect, so containers must not bypass it.
+template <typename T> struct marking_allocator : std::allocator<T> {
+  template <typename U> struct rebind {
+    using other = marking_allocator<U>;
+  };
+  marking_allocator() = default;
+  template <typename U> marking_allocator(marking_allocator<U> const &) {}
+  template <typename U, typename... Args> void construct(U *p, Args &&...args) { ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...); }
+  template <typename U> void construct(U *p) { ::new (static_cast<void *>(p)) U(0x5a); }
+};
+
 int main() {
   using namespace std;
   using namespace rpnx;
@@ -127,6 +161,1313 @@ int main() {
   assert(test.back() == 7);
 #endif
 
+  {
+    rpnx::monoque<size_t> segs;
+    assert(segs.segment_count() == 0);
+    for (size_t i = 0; i < 1000; i++)
+      segs.push_back(i);
+
+    size_t n = 0;
+    for (auto seg : segs.segments())
+      for (auto x : seg)
+        assert(x == n++);
+    assert(n == segs.size());
+
+    size_t first = 3, next = 3;
+    segs.for_each_segment(first, 700, [&](size_t const *p, size_t len) {
+      for (size_t i = 0; i < len; i++)
+        assert(p[i] == next++);
+    });
+    assert(next == 700);
+  }
+
+  {
+    vector<size_t> src;
+    for (size_t i = 0; i < 777; i++)
+      src.push_back(i * 3);
+
+    rpnx::monoque<size_t> a;
+    a.assign(src.begin(), src.end());
+    assert(vector<size_t>(a.begin(), a.end()) == src);
+
+    list<size_t> lst(src.begin(), src.begin() + 100);
+    a.append(lst.begin(), lst.end());
+    assert(a.size() == 877 && a[776] == 776 * 3 && a[777] == 0 && a[876] == 99 * 3);
+
+    istringstream in("5 6 7");
+    rpnx::monoque<int> b((istream_iterator<int>(in)), istream_iterator<int>());
+    assert(b.size() == 3 && b[2] == 7);
+
+    rpnx::monoque<size_t> c(a);
+    assert(c.size() == a.size() && equal(a.begin(), a.end(), c.begin()));
+
+    rpnx::monoque<size_t> d(100, 42);
+    d.append_n(3, 7);
+    assert(d.size() == 103 && d[99] == 42 && d[102] == 7);
+    d = c;
+    assert(d.size() == c.size() && d[500] == c[500]);
+
+    // Ranges of another monoque, even one with a different layout, are copied source block by source block.
+    rpnx::monoque<size_t, std::allocator<size_t>, 64> wide;
+    wide.assign(a.cbegin() + 3, a.cend() - 2);
+    assert(wide.size() == a.size() - 5 && equal(wide.begin(), wide.end(), a.begin() + 3));
+    wide.append(a.begin() + 100, a.begin() + 400);
+    assert(wide.size() == a.size() + 295 && wide[a.size() - 5] == a[100] && wide[wide.size() - 1] == a[399]);
+    rpnx::monoque<size_t> narrow(wide.begin(), wide.end());
+    assert(narrow.size() == wide.size() && equal(narrow.begin(), narrow.end(), wide.begin()));
+
+    size_t live = tester::dval;
+    {
+      rpnx::monoque<tester> e(70, tester());
+      rpnx::monoque<tester> f(e);
+      f.append(e.begin(), e.end());
+      assert(f.size() == 140);
+      f.append(f.cbegin() + 5, f.cend());
+      assert(f.size() == 275);
+    }
+    assert(tester::dval == live);
+  }
+
+  {
+    rpnx::concurrent_monoque<size_t> cm;
+    vector<thread> producers;
+    for (size_t t = 0; t < 4; t++)
+      producers.emplace_back([&cm, t] {
+        for (size_t i = 0; i < 20000; i++)
+          cm.emplace_back(t * 20000 + i);
+      });
+    for (auto &t : producers)
+      t.join();
+
+    assert(cm.size() == 80000);
+    vector<bool> seen(80000);
+    for (size_t i = 0; i < cm.size(); i++) {
+      assert(cm.published(i));
+      assert(!seen[cm[i]]);
+      seen[cm[i]] = true;
+    }
+    assert(!cm.published(80000) && cm.try_get(80000) == nullptr);
+
+    // Each block's bitmap is cleared by the pushes into the block before it; nothing unpushed ever reads as published.
+    rpnx::concurrent_monoque<uint32_t> one;
+    for (uint32_t i = 0; i < 300000; i++) {
+      assert(one.emplace_back(i) == i && one.published(i) && !one.published(i + 1));
+      assert(one[i / 2] == i / 2);
+    }
+
+    // Byte-sized and over-aligned elements share a block with the bitmap; destructors run once per element.
+    size_t live = tester::dval;
+    {
+      struct alignas(64) wide {
+        uint32_t v;
+      };
+      rpnx::concurrent_monoque<char> bytes;
+      rpnx::concurrent_monoque<wide> lines;
+      rpnx::concurrent_monoque<tester> objects;
+      vector<thread> mixed;
+      for (size_t t = 0; t < 3; t++)
+        mixed.emplace_back([&, t] {
+          for (uint32_t i = 0; i < 5000; i++) {
+            bytes.push_back(char(i));
+            lines.push_back(wide{uint32_t(t * 5000 + i)});
+            // tester's live count is not atomic, so only one producer makes them.
+            if (t == 0)
+              for (size_t j = 0; j < 3; j++)
+                objects.emplace_back();
+          }
+        });
+      for (auto &t : mixed)
+        t.join();
+      assert(bytes.size() == 15000 && lines.size() == 15000 && tester::dval == live + 15000);
+      uint64_t total = 0;
+      for (size_t i = 0; i < lines.size(); i++) {
+        assert(lines.published(i) && reinterpret_cast<uintptr_t>(&lines[i]) % 64 == 0);
+        total += lines[i].v;
+      }
+      assert(total == 14999ull * 15000 / 2);
+    }
+    assert(tester::dval == live);
+  }
+
+  {
+    rpnx::monodeque<int> md;
+    deque<int> ref;
+    for (int i = 1; i < 3000; i++) {
+      if (i % 3 == 0) {
+        md.push_front(i);
+        ref.push_front(i);
+      } else {
+        md.push_back(i);
+        ref.push_back(i);
+      }
+      if (i % 7 == 0) {
+        md.pop_back();
+        ref.pop_back();
+      }
+      if (i % 11 == 0) {
+        md.pop_front();
+        ref.pop_front();
+      }
+    }
+    assert(md.size() == ref.size() && equal(md.begin(), md.end(), ref.begin()));
+    assert(md.front() == ref.front() && md.back() == ref.back() && md[100] == ref[100]);
+
+    md.shrink_to_fit();
+    sort(md.begin(), md.end());
+    sort(ref.begin(), ref.end());
+    assert(equal(md.rbegin(), md.rend(), ref.rbegin()));
+
+    size_t live = tester::dval;
+    {
+      rpnx::monodeque<tester> mt;
+      for (int i = 0; i < 50; i++) {
+        mt.emplace_front();
+        mt.emplace_back();
+      }
+      mt.pop_front();
+      rpnx::monodeque<tester> copy(mt);
+      assert(copy.size() == 99);
+    }
+    assert(tester::dval == live);
+
+    // Blocks a sliding window leaves behind are freed, and an emptied deque gives its large blocks back.
+    struct counting_resource : std::pmr::memory_resource {
+      size_t live = 0;
+      void *do_allocate(size_t bytes, size_t align) override {
+        live += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, align);
+      }
+      void do_deallocate(void *p, size_t bytes, size_t align) override {
+        live -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+      }
+      bool do_is_equal(std::pmr::memory_resource const &o) const noexcept override { return this == &o; }
+    } counted;
+    {
+      using window_type = rpnx::monodeque<uint64_t, std::pmr::polymorphic_allocator<uint64_t>>;
+      window_type window{window_type::allocator_type(&counted)};
+      deque<uint64_t> wref;
+      for (int dir = 0; dir < 2; dir++) {
+        for (uint64_t i = 0; i < (1 << 18); i++) {
+          if (dir == 0) {
+            window.push_back(i);
+            wref.push_back(i);
+          } else {
+            window.push_front(i);
+            wref.push_front(i);
+          }
+          if (wref.size() > 10) {
+            if (dir == 0) {
+              window.pop_front();
+              wref.pop_front();
+            } else {
+              window.pop_back();
+              wref.pop_back();
+            }
+          }
+          // The blocks holding the window plus one spare behind it, not every block passed on the way.
+          if (i % 4096 == 0 && i > 64) {
+            size_t lead = rpnx::monoque_layout::sizeat(i), trail = rpnx::monoque_layout::sizeat(i - 9);
+            size_t bound = lead == trail ? lead + lead / 2 : lead + trail + trail / 2;
+            assert(counted.live <= sizeof(uint64_t) * (bound + 16));
+          }
+        }
+        assert(equal(window.begin(), window.end(), wref.begin()));
+        while (!window.empty()) {
+          window.pop_back();
+          wref.pop_back();
+        }
+        assert(counted.live <= 8 * sizeof(uint64_t));
+      }
+
+      // pmr allocators do not propagate: assignment keeps each deque's resource, and moves element by element across resources.
+      counting_resource other_resource;
+      window_type a{window_type::allocator_type(&counted)}, b{window_type::allocator_type(&other_resource)};
+      for (uint64_t i = 0; i < 100; i++)
+        b.push_back(i);
+      a = std::move(b);
+      assert(a.get_allocator().resource() == &counted && b.get_allocator().resource() == &other_resource && a.size() == 100 && a[99] == 99);
+      b = a;
+      assert(b.get_allocator().resource() == &other_resource && b.size() == 100 && other_resource.live != 0);
+      window_type c{window_type::allocator_type(&counted)};
+      c.swap(a);
+      assert(c.size() == 100 && a.empty() && c.get_allocator().resource() == &counted);
+    }
+    assert(counted.live == 0);
+  }
+
+  {
+    string path = "/tmp/monoque_tester_" + to_string(getpid()) + ".mq";
+    {
+      rpnx::mapped_monoque<uint64_t> mm(path);
+      for (uint64_t i = 0; i < 100000; i++)
+        mm.push_back(i * i);
+      mm.sync();
+    }
+    {
+      rpnx::mapped_monoque<uint64_t> mm(path);
+      assert(mm.size() == 100000 && mm[99999] == 99999ull * 99999ull);
+      mm.pop_back();
+      mm.push_back(1);
+    }
+    {
+      rpnx::mapped_monoque<uint64_t> mm(path);
+      uint64_t n = 0;
+      mm.for_each_segment([&](uint64_t const *p, size_t len) {
+        for (size_t i = 0; i < len; i++, n++)
+          assert(p[i] == (n == 99999 ? 1 : n * n));
+      });
+      assert(n == 100000);
+    }
+
+    // Small blocks share the header's 64 KiB unit, and the alignment is part of the format.
+    {
+      rpnx::mapped_monoque<uint64_t> mm(path + ".small");
+      for (uint64_t i = 0; i < 1000; i++)
+        mm.push_back(i);
+    }
+    struct stat st;
+    assert(stat((path + ".small").c_str(), &st) == 0 && st.st_size == 65536);
+    {
+      rpnx::mapped_monoque<uint64_t> mm(path + ".small");
+      assert(mm.size() == 1000 && mm[999] == 999 && mm[1] == 1);
+    }
+    int fd = open((path + ".small").c_str(), O_RDWR);
+    uint64_t alignment = 4096;
+    pwrite(fd, &alignment, sizeof(alignment), 24);
+    close(fd);
+    bool caught = false;
+    try {
+      rpnx::mapped_monoque<uint64_t> mm(path + ".small");
+    } catch (std::runtime_error const &) {
+      caught = true;
+    }
+    assert(caught);
+    unlink((path + ".small").c_str());
+    unlink(path.c_str());
+  }
+
+  {
+    string path = "/tmp/monoque_tester_" + to_string(getpid()) + ".mqs";
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    assert(fd >= 0);
+
+    rpnx::monoque<uint32_t> src;
+    for (uint32_t i = 0; i < 1000; i++)
+      src.push_back(i * 7);
+    rpnx::save(fd, src);
+    size_t saved = src.size();
+    for (uint32_t i = 1000; i < 5000; i++)
+      src.push_back(i * 7);
+    rpnx::checkpoint_since(fd, src, saved);
+
+    rpnx::monoque<uint32_t> dst;
+    lseek(fd, 0, SEEK_SET);
+    rpnx::load(fd, dst);
+    assert(dst.size() == 5000 && equal(src.begin(), src.end(), dst.begin()));
+
+    // Flip a byte in the last record's payload.
+    uint32_t bad = 1;
+    pwrite(fd, &bad, sizeof(bad), lseek(fd, 0, SEEK_END) - 4);
+    lseek(fd, 0, SEEK_SET);
+    bool caught = false;
+    try {
+      rpnx::load(fd, dst);
+    } catch (std::runtime_error const &) {
+      caught = true;
+    }
+    assert(caught && dst.size() == 5000);
+    close(fd);
+
+    // A corrupted count is rejected before it sizes any allocation.
+    fd = open(path.c_str(), O_RDWR | O_TRUNC);
+    rpnx::save(fd, src);
+    for (uint64_t count : {uint64_t(0), uint64_t(3), ~uint64_t(0)}) {
+      pwrite(fd, &count, sizeof(count), sizeof(rpnx::monoque_io::header) + offsetof(rpnx::monoque_io::record, count));
+      lseek(fd, 0, SEEK_SET);
+      caught = false;
+      try {
+        rpnx::load(fd, dst);
+      } catch (std::runtime_error const &e) {
+        caught = std::string(e.what()) == "monoque_io: corrupt record";
+      }
+      assert(caught && dst.size() == 5000);
+    }
+    close(fd);
+    unlink(path.c_str());
+  }
+
+  {
+    rpnx::parallel::thread_pool pool(3);
+    rpnx::monoque<uint64_t> pm;
+    for (uint64_t i = 0; i < 1000003; i++)
+      pm.push_back(i % 1000);
+
+    rpnx::parallel::for_each(pm, [](uint64_t &x) { x += 1; }, pool);
+    uint64_t serial = accumulate(pm.begin(), pm.end(), uint64_t(0));
+    assert(rpnx::parallel::reduce(pm, pool) == serial);
+    assert(rpnx::parallel::reduce(pm, uint64_t(5), [](uint64_t a, uint64_t b) { return max(a, b); }, pool) == 1000);
+
+    rpnx::monoque<double> halves;
+    rpnx::parallel::transform(pm, halves, [](uint64_t x) { return x / 2.0; }, pool);
+    assert(halves.size() == pm.size() && halves[999] == 500.0);
+
+    vector<uint64_t> expect(pm.begin(), pm.end());
+    partial_sum(expect.begin(), expect.end(), expect.begin());
+    rpnx::parallel::inclusive_scan(pm, pool);
+    assert(equal(expect.begin(), expect.end(), pm.begin()));
+
+    // Source and destination with different block boundaries.
+    rpnx::monoque<uint32_t, std::allocator<uint32_t>, 64> wide;
+    rpnx::compact_monoque<uint32_t> compact;
+    for (uint32_t i = 0; i < 300007; i++) {
+      wide.push_back(i % 1000);
+      compact.push_back(i % 1000);
+    }
+    rpnx::monoque<uint32_t> narrow;
+    rpnx::parallel::transform(wide, narrow, [](uint32_t x) { return x * 3; }, pool);
+    assert(narrow.size() == wide.size() && narrow[300006] == 300006 % 1000 * 3 && narrow[64] == 64 * 3);
+    rpnx::monoque<uint64_t, std::allocator<uint64_t>, 16> from_compact;
+    rpnx::parallel::transform(compact, from_compact, [](uint32_t x) { return uint64_t(x) + 1; }, pool);
+    assert(from_compact.size() == compact.size() && from_compact[299999] == 1000);
+    rpnx::monoque<uint64_t> sums;
+    rpnx::parallel::inclusive_scan(wide, sums, [](uint64_t a, uint64_t b) { return a + b; }, pool);
+    vector<uint64_t> wide_expect(wide.begin(), wide.end());
+    partial_sum(wide_expect.begin(), wide_expect.end(), wide_expect.begin());
+    assert(equal(wide_expect.begin(), wide_expect.end(), sums.begin()));
+
+    bool caught = false;
+    try {
+      rpnx::parallel::for_each(pm, [](uint64_t &x) {
+        if (x != 0)
+          throw std::runtime_error("boom");
+      }, pool);
+    } catch (std::runtime_error const &) {
+      caught = true;
+    }
+    assert(caught);
+  }
+
+  {
+    rpnx::monoque<int32_t> si;
+    rpnx::monoque<double> sd;
+    for (int32_t i = 0; i < 100000; i++) {
+      si.push_back((i * 7919) % 10007 - 5000);
+      sd.push_back(i * 0.5);
+    }
+    int64_t isum = 0;
+    for (auto x : si)
+      isum += x;
+
+    for (auto level : {rpnx::simd::isa::scalar, rpnx::simd::isa::sse2, rpnx::simd::isa::avx2, rpnx::simd::isa::avx512}) {
+      rpnx::simd::set_isa(level);
+      assert(rpnx::simd::sum(si) == int32_t(isum));
+      assert(rpnx::simd::min(si) == *min_element(si.begin(), si.end()));
+      assert(rpnx::simd::max(si) == *max_element(si.begin(), si.end()));
+      assert(rpnx::simd::count(si, 17) == size_t(count(si.begin(), si.end(), 17)));
+      assert(rpnx::simd::find(si, si[77777]) == size_t(find(si.begin(), si.end(), si[77777]) - si.begin()));
+      assert(rpnx::simd::find(si, 123456) == si.size());
+      assert(rpnx::simd::find_if(sd, [](double x) { return x > 30000.2; }) == 60001);
+      assert(rpnx::simd::sum(sd) == 0.5 * 99999.0 * 100000.0 / 2);
+      assert(rpnx::simd::max(sd) == 49999.5);
+    }
+  }
+
+  {
+    size_t live = tester::dval;
+    {
+      rpnx::monoque<size_t, std::allocator<size_t>, 64> wide;
+      rpnx::monoque<size_t> narrow;
+      for (size_t i = 0; i < 5000; i++) {
+        wide.push_back(i);
+        narrow.push_back(i);
+      }
+      assert(wide.segment(0).size() == 64 && wide.segment(1).size() == 64 && wide.segment(2).size() == 128);
+      assert(equal(wide.begin(), wide.end(), narrow.begin()));
+
+      rpnx::monoque<tester, std::allocator<tester>, 8, true> small, big;
+      for (int i = 0; i < 3; i++)
+        small.emplace_back();
+      for (int i = 0; i < 40; i++)
+        big.emplace_back();
+      assert(small.segment(0).data() == &small[0]);
+      small.swap(big);
+      assert(small.size() == 40 && big.size() == 3);
+      rpnx::monoque<tester, std::allocator<tester>, 8, true> moved(std::move(small));
+      assert(moved.size() == 40 && small.size() == 0);
+      moved.clear();
+      moved.shink_to_fit();
+      assert(tester::dval == live + 3);
+    }
+    assert(tester::dval == live);
+  }
+
+  {
+    rpnx::monoque<tester> reuse;
+    size_t live = tester::dval;
+    for (int i = 0; i < 100; i++)
+      reuse.emplace_back();
+    tester *first = &reuse[50];
+    reuse.clear();
+    assert(reuse.empty() && tester::dval == live);
+    for (int i = 0; i < 100; i++)
+      reuse.emplace_back();
+    assert(&reuse[50] == first);
+    reuse.clear();
+
+    rpnx::segment_cache cache(1 << 20);
+    using cached = rpnx::monoque<uint64_t, rpnx::caching_allocator<uint64_t>>;
+    for (int round = 0; round < 3; round++) {
+      cached m{rpnx::caching_allocator<uint64_t>(cache)};
+      for (uint64_t i = 0; i < 10000; i++)
+        m.push_back(i);
+    }
+    assert(cache.misses() == 14 && cache.hits() == 28);
+    assert(cache.cached_bytes() == 16384 * sizeof(uint64_t));
+
+    cache.set_byte_limit(0);
+    {
+      cached m{rpnx::caching_allocator<uint64_t>(cache)};
+      for (uint64_t i = 0; i < 10000; i++)
+        m.push_back(i);
+    }
+    assert(cache.cached_bytes() == 0);
+
+    // A container bound to a thread's cache keeps that cache alive after the thread exits.
+    std::unique_ptr<cached> survivor;
+    std::thread([&] {
+      cached m{rpnx::caching_allocator<uint64_t>(rpnx::thread_segment_cache())};
+      for (uint64_t i = 0; i < 1000; i++)
+        m.push_back(i);
+      survivor.reset(new cached(std::move(m)));
+    }).join();
+    for (uint64_t i = 1000; i < 5000; i++)
+      survivor->push_back(i);
+    assert((*survivor)[4999] == 4999 && survivor->get_allocator().cache().misses() != 0);
+    survivor.reset();
+
+    // Blocks smaller than a pointer are not cached; the free lists never allocate.
+    rpnx::segment_cache tiny;
+    {
+      rpnx::monoque<char, rpnx::caching_allocator<char>> c{rpnx::caching_allocator<char>(tiny)};
+      for (int i = 0; i < 100; i++)
+        c.push_back(char(i));
+    }
+    assert(tiny.cached_bytes() == 128 - 8);
+  }
+
+  {
+    using huge = rpnx::hugepage_allocator<uint64_t, 64, (1 << 16), rpnx::huge_pages::transparent, true>;
+    rpnx::monoque<uint64_t, huge> hm;
+    for (uint64_t i = 0; i < 300000; i++)
+      hm.push_back(i);
+    for (auto seg : hm.segments()) {
+      assert(uintptr_t(seg.data()) % 64 == 0);
+      if (seg.size() * sizeof(uint64_t) >= (1 << 16))
+        assert(uintptr_t(seg.data()) % (2 << 20) == 0);
+    }
+    assert(hm[299999] == 299999);
+
+    rpnx::monoque<uint64_t, rpnx::hugepage_allocator<uint64_t, 4096, (1 << 16), rpnx::huge_pages::explicit_>> em;
+    for (uint64_t i = 0; i < 300000; i++)
+      em.push_back(i);
+    assert(uintptr_t(&em[0]) % 4096 == 0 && em[299999] == 299999);
+  }
+
+  {
+    rpnx::monoque<uint64_t> r;
+    r.reserve(1000);
+    assert(r.capacity() == 1024 && r.empty());
+    r.push_back(7);
+    uint64_t *first = &r[0];
+    for (uint64_t i = 1; i < 1000; i++)
+      r.push_back(i);
+    assert(&r[0] == first && r.capacity() == 1024);
+
+    rpnx::monoque<uint64_t> pre;
+    pre.set_preallocation(0.5f);
+    for (uint64_t i = 0; i < 1000; i++)
+      pre.push_back(i);
+    assert(pre.capacity() == 2048);
+    for (uint64_t i = 1000; i < 100000; i++)
+      pre.push_back(i);
+    assert(pre.capacity() == 262144 && pre[99999] == 99999);
+    pre.set_preallocation(0);
+    for (uint64_t i = 100000; i < 120000; i++)
+      pre.push_back(i);
+    assert(pre.capacity() == 262144 && pre[119999] == 119999);
+
+    // fill = 1 still allocates ahead, on the push into the last slot of a block.
+    rpnx::monoque<uint64_t> full;
+    full.set_preallocation(1.0f);
+    for (uint64_t i = 0; i < 1024; i++)
+      full.push_back(i);
+    assert(full.capacity() == 2048 && full[1023] == 1023);
+
+    // Shrinking re-arms preallocation, so regrowing allocates ahead again.
+    rpnx::monoque<uint64_t> again;
+    again.set_preallocation(0.5f);
+    for (uint64_t i = 0; i < 5000; i++)
+      again.push_back(i);
+    again.truncate(10);
+    again.shink_to_fit();
+    assert(again.capacity() == 16);
+    for (uint64_t i = 10; i < 1000; i++)
+      again.push_back(i);
+    assert(again.capacity() == 2048 && again[999] == 999);
+    while (again.size() > 3)
+      again.pop_back();
+    again.shink_to_fit();
+    for (uint64_t i = 3; i < 1000; i++)
+      again.push_back(i);
+    assert(again.capacity() == 2048);
+    again.clear();
+    again.shink_to_fit();
+    for (uint64_t i = 0; i < 1000; i++)
+      again.push_back(i);
+    assert(again.capacity() == 2048);
+  }
+
+  {
+    std::vector<size_t> sizes = {0, 1, 3, 1000, 100000, 300001};
+    for (size_t n : sizes) {
+      rpnx::monoque<int64_t> a;
+      rpnx::monoque<std::string> b;
+      rpnx::monoque<std::pair<uint16_t, int32_t>> c;
+      std::vector<int64_t> ref;
+      uint64_t x = 88172645463325252ull;
+      for (size_t i = 0; i < n; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        a.push_back(int64_t(x));
+        ref.push_back(int64_t(x));
+        if (i < 20000)
+          b.push_back(std::to_string(x % 1000));
+        c.push_back(std::make_pair(uint16_t(x % 7), int32_t(x >> 40) - (1 << 22)));
+      }
+      rpnx::monoque<int64_t> a2 = a;
+      // Neither default constructible nor copyable, so sort must not need either.
+      struct boxed {
+        explicit boxed(int64_t v) : v(new int64_t(v)) {}
+        std::unique_ptr<int64_t> v;
+      };
+      rpnx::monoque<boxed> d;
+      for (int64_t v : ref)
+        d.emplace_back(v);
+      std::vector<std::pair<uint16_t, int32_t>> cref(c.begin(), c.end());
+      std::vector<std::string> bref(b.begin(), b.end());
+
+      std::sort(ref.begin(), ref.end());
+      std::sort(bref.begin(), bref.end());
+
+      rpnx::sort(a);
+      rpnx::sort(a2, std::greater<int64_t>());
+      rpnx::sort(b);
+      rpnx::radix_sort(c);
+      rpnx::sort(d, [](boxed const &l, boxed const &r) { return *l.v < *r.v; });
+      assert(std::equal(ref.begin(), ref.end(), a.begin()) && a.size() == n);
+      assert(std::equal(ref.begin(), ref.end(), d.begin(), [](int64_t v, boxed const &b) { return *b.v == v; }) && d.size() == n);
+      assert(std::equal(ref.rbegin(), ref.rend(), a2.begin()));
+      assert(std::equal(bref.begin(), bref.end(), b.begin()) && b.size() == bref.size());
+      std::sort(cref.begin(), cref.end());
+      assert(std::equal(cref.begin(), cref.end(), c.begin()));
+    }
+  }
+
+  {
+    rpnx::monoque_heap<uint64_t> h;
+    std::priority_queue<uint64_t> ref;
+    uint64_t x = 88172645463325252ull;
+    for (size_t i = 0; i < 20000; i++) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      if (x % 5 < 3 || h.empty()) {
+        h.push(x % 1000);
+        ref.push(x % 1000);
+      } else if (x % 5 == 3) {
+        h.pop_push(x % 997);
+        ref.pop();
+        ref.push(x % 997);
+      } else {
+        h.pop();
+        ref.pop();
+      }
+      assert(h.size() == ref.size() && h.top() == ref.top());
+    }
+
+    // Bulk heapify, then an incremental push_range on top of it.
+    std::vector<std::string> words;
+    for (size_t i = 0; i < 5000; i++)
+      words.push_back(std::to_string(i * 7919 % 5003));
+    rpnx::monoque_heap<std::string, std::greater<std::string>> w(words.begin(), words.begin() + 4000);
+    w.push_range(words.begin() + 4000, words.end());
+    rpnx::monoque_heap<std::string, std::greater<std::string>> w2 = w;
+    std::sort(words.begin(), words.end());
+    for (auto const &s : words) {
+      assert(w.top() == s);
+      w.pop();
+    }
+    assert(w.empty() && w2.size() == 5000 && w2.top() == words.front());
+    w.push("z");
+    assert(w.size() == 1 && w.top() == "z");
+
+    // Move-only elements: pushes move, never copy.
+    auto deref_less = [](std::unique_ptr<int> const &a, std::unique_ptr<int> const &b) { return *a < *b; };
+    rpnx::monoque_heap<std::unique_ptr<int>, decltype(deref_less)> owned(deref_less);
+    for (int i = 0; i < 100; i++)
+      owned.push(std::unique_ptr<int>(new int(i * 37 % 101)));
+    owned.emplace(new int(1000));
+    assert(owned.size() == 101 && *owned.top() == 1000);
+    owned.pop();
+    int prev = 101, popped = 0;
+    for (; !owned.empty(); owned.pop(), popped++) {
+      assert(*owned.top() < prev);
+      prev = *owned.top();
+    }
+    assert(popped == 100);
+  }
+
+  {
+    static_assert(sizeof(rpnx::monoque<uint64_t>) == sizeof(rpnx::monoque<uint64_t, std::allocator<uint64_t>, 2, false, rpnx::no_monoque_stats>), "");
+    rpnx::monoque<uint64_t, std::allocator<uint64_t>, 2, false, rpnx::counting_monoque_stats<1>> m;
+    for (uint64_t i = 0; i < 100; i++)
+      m.push_back(i);
+    assert(m[0] + m[99] == 99);
+
+    rpnx::monoque_stats_snapshot s = m.stats();
+    assert(s.segments == 7 && s.bytes_reserved == 128 * sizeof(uint64_t) && s.bytes_used == 100 * sizeof(uint64_t));
+    assert(s.segment_allocations == 7 && s.segment_frees == 0 && s.peak_segments == 7 && s.peak_bytes_reserved == s.bytes_reserved);
+    assert(s.access_samples[0] == 1 && s.access_samples[6] == 1 && s.allocate_ns >= s.max_allocate_ns);
+
+    // Access sampling from const operator[] tolerates concurrent readers.
+    rpnx::monoque<uint64_t, std::allocator<uint64_t>, 2, false, rpnx::counting_monoque_stats<1>> const &shared = m;
+    std::vector<std::thread> readers;
+    std::vector<uint64_t> sums(4, 0);
+    for (size_t t = 0; t < 4; t++)
+      readers.emplace_back([&, t] {
+        for (size_t r = 0; r < 1000; r++)
+          sums[t] += shared[r % 100];
+      });
+    for (auto &r : readers)
+      r.join();
+    s = m.stats();
+    assert(sums[0] == 10 * 4950 && sums[3] == sums[0] && s.access_samples[6] >= 1);
+
+    m.resize(10);
+    m.shink_to_fit();
+    auto moved = std::move(m);
+    s = moved.stats();
+    assert(s.segments == 4 && s.segment_frees == 3 && s.peak_segments == 7 && s.bytes_used == 10 * sizeof(uint64_t));
+
+    rpnx::monoque<uint64_t> plain;
+    plain.push_back(1);
+    s = plain.stats();
+    assert(s.segments == 1 && s.bytes_used == sizeof(uint64_t) && s.segment_allocations == 0);
+
+    // An inline block is reserved memory too, so the slack never goes negative.
+    rpnx::monoque<uint64_t, std::allocator<uint64_t>, 8, true> inl;
+    inl.push_back(1);
+    s = inl.stats();
+    assert(s.segments == 0 && s.bytes_reserved == 8 * sizeof(uint64_t) && s.bytes_reserved - s.bytes_used == 7 * sizeof(uint64_t));
+    static_assert(sizeof(rpnx::counting_monoque_stats<0>) == 8 * sizeof(uint64_t), "no sampling state without sampling");
+  }
+
+  {
+    rpnx::monoque<std::string> m;
+    rpnx::monoque<uint32_t> t;
+    std::vector<std::string> ref;
+    std::vector<uint32_t> tref;
+    uint64_t x = 88172645463325252ull;
+    for (size_t step = 0; step < 3000; step++) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      size_t pos = x % (ref.size() + 1), tpos = x % (tref.size() + 1);
+      size_t k = (x >> 20) % 70;
+      std::string v = "v" + std::to_string(step);
+      switch ((x >> 32) % 6) {
+      case 0:
+        m.insert(m.begin() + pos, v);
+        ref.insert(ref.begin() + pos, v);
+        t.insert(t.begin() + tpos, uint32_t(step));
+        tref.insert(tref.begin() + tpos, uint32_t(step));
+        break;
+      case 1:
+        m.insert(m.begin() + pos, k, v);
+        ref.insert(ref.begin() + pos, k, v);
+        t.insert(t.begin() + tpos, k, uint32_t(step));
+        tref.insert(tref.begin() + tpos, k, uint32_t(step));
+        break;
+      case 2: {
+        std::list<std::string> src(k, v);
+        m.insert(m.begin() + pos, src.begin(), src.end());
+        ref.insert(ref.begin() + pos, src.begin(), src.end());
+        std::vector<uint32_t> tsrc(k, uint32_t(step));
+        t.insert(t.begin() + tpos, tsrc.begin(), tsrc.end());
+        tref.insert(tref.begin() + tpos, tsrc.begin(), tsrc.end());
+        break;
+      }
+      case 3: {
+        size_t end = std::min(ref.size(), pos + k / 2), tend = std::min(tref.size(), tpos + k / 2);
+        m.erase(m.begin() + pos, m.begin() + end);
+        ref.erase(ref.begin() + pos, ref.begin() + end);
+        t.erase(t.begin() + tpos, t.begin() + tend);
+        tref.erase(tref.begin() + tpos, tref.begin() + tend);
+        break;
+      }
+      case 4:
+        if (pos < ref.size()) {
+          m.erase(m.begin() + pos);
+          ref.erase(ref.begin() + pos);
+        }
+        if (tpos < tref.size()) {
+          t.erase(t.begin() + tpos);
+          tref.erase(tref.begin() + tpos);
+        }
+        break;
+      default:
+        if (step % 50 == 0) {
+          auto pred = [&](std::string const &s) { return s.size() % 3 == step % 3; };
+          size_t before = ref.size();
+          ref.erase(std::remove_if(ref.begin(), ref.end(), pred), ref.end());
+          assert(m.erase_if(pred) == before - ref.size());
+          tref.erase(std::remove_if(tref.begin(), tref.end(), [](uint32_t e) { return e % 4 == 1; }), tref.end());
+          erase_if(t, [](uint32_t e) { return e % 4 == 1; });
+        }
+      }
+      assert(m.size() == ref.size() && t.size() == tref.size());
+    }
+    assert(std::equal(ref.begin(), ref.end(), m.begin()) && std::equal(tref.begin(), tref.end(), t.begin()));
+
+    // Inserting an element of the container itself, and from a single pass range.
+    m.assign({"a", "b", "c"});
+    m.insert(m.begin(), 2, m[2]);
+    std::istringstream words("x y");
+    m.insert(m.begin() + 1, std::istream_iterator<std::string>(words), std::istream_iterator<std::string>());
+    assert(m.size() == 7 && m[0] == "c" && m[1] == "x" && m[2] == "y" && m[3] == "c" && m[6] == "c");
+    assert(erase(m, std::string("c")) == 3 && m.size() == 4 && m[3] == "b");
+
+    size_t live = tester::dval;
+    {
+      rpnx::monoque<tester> l(100);
+      l.insert(l.begin() + 10, 50, tester());
+      l.erase(l.begin() + 3, l.begin() + 90);
+      l.erase_if([](tester const &) { return true; });
+      assert(l.empty());
+    }
+    assert(tester::dval == live);
+  }
+
+  {
+    rpnx::monoque_queue<uint64_t> q;
+    std::deque<uint64_t> ref;
+    uint64_t x = 88172645463325252ull;
+    size_t peak = 0;
+    for (uint64_t i = 0; i < 200000; i++) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      peak = std::max(peak, q.capacity());
+      // Grow for the first half, then drain.
+      if (ref.empty() || x % 4 < (i < 100000 ? 3u : 1u)) {
+        q.push_back(i);
+        ref.push_back(i);
+      } else {
+        assert(q.front() == ref.front());
+        q.pop_front();
+        ref.pop_front();
+      }
+      assert(q.size() == ref.size() && (ref.empty() || q.back() == ref.back()));
+    }
+    while (!ref.empty()) {
+      assert(q.front() == ref.front());
+      q.pop_front();
+      ref.pop_front();
+    }
+    // Drained, the queue keeps at most one spare of 2 * min_block (128 uint64_t per 1 KiB).
+    assert(q.capacity() <= 2 * 128);
+
+    // A burst's blocks are freed as they are consumed; a small steady-state queue then holds its
+    // live blocks plus one spare of at most 2 * min_block.
+    for (uint64_t i = 0; i < (1 << 18); i++)
+      q.push(i);
+    while (q.size() > 10) {
+      q.push(0);
+      q.pop();
+      q.pop();
+    }
+    for (uint64_t i = 0; i < 100000; i++) {
+      q.push(i);
+      if (q.size() > 10)
+        q.pop();
+      if (i > 1000)
+        assert(q.capacity() <= 3 * 128);
+    }
+    assert(q.size() == 10 && q.front() == 99990 && peak >= 32768);
+
+    rpnx::monoque_queue<std::string> s;
+    for (int i = 0; i < 5000; i++)
+      s.emplace_back(std::to_string(i));
+    for (int i = 0; i < 4990; i++)
+      s.pop_front();
+    rpnx::monoque_queue<std::string> s2 = s;
+    std::vector<std::string> rest;
+    s2.for_each_segment([&](std::string *p, size_t n) { rest.insert(rest.end(), p, p + n); });
+    assert(rest.size() == 10 && rest.front() == "4990" && rest.back() == "4999" && s.front() == "4990");
+
+    size_t live = tester::dval;
+    {
+      rpnx::monoque_queue<tester> t;
+      for (int i = 0; i < 3000; i++)
+        t.push_back(tester());
+      for (int i = 0; i < 1000; i++)
+        t.pop_front();
+    }
+    assert(tester::dval == live);
+  }
+
+  {
+    rpnx::bit_monoque<> b;
+    rpnx::bit_monoque<std::allocator<uint64_t>, false> plain;
+    std::vector<bool> ref;
+    uint64_t x = 88172645463325252ull;
+    for (size_t i = 0; i < 20000; i++) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      bool v = x % 7 == 0;
+      b.push_back(v);
+      plain.push_back(v);
+      ref.push_back(v);
+    }
+    for (size_t step = 0; step < 2000; step++) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      size_t i = x % ref.size();
+      if (step % 3 == 0) {
+        b.flip(i);
+        plain.flip(i);
+        ref[i] = !ref[i];
+      } else {
+        b.set(i, step % 2);
+        plain.set(i, step % 2);
+        ref[i] = step % 2;
+      }
+      size_t q = (x >> 32) % (ref.size() + 1);
+      size_t expect = size_t(std::count(ref.begin(), ref.begin() + q, true));
+      assert(b.rank(q) == expect && plain.rank(q) == expect);
+      size_t next = q;
+      while (next < ref.size() && !ref[next])
+        next++;
+      assert(b.find_next_set(q) == next && b.test(i) == ref[i]);
+    }
+    assert(b.count() == size_t(std::count(ref.begin(), ref.end(), true)) && b.count() == plain.count());
+    for (size_t i = 0; i < 100; i++) {
+      b.pop_back();
+      ref.pop_back();
+    }
+    assert(b.size() == ref.size() && b.count() == size_t(std::count(ref.begin(), ref.end(), true)));
+    assert(b.words().size() == (ref.size() + 63) / 64);
+
+    rpnx::bit_monoque<> ones(130, true);
+    assert(ones.count() == 130 && ones.rank(65) == 65 && ones.find_next_set(129) == 129 && ones.find_next_set(130) == 130);
+    rpnx::bit_monoque<> sparse(100000, false);
+    sparse.set(99999);
+    assert(sparse.find_next_set(5) == 99999 && sparse.count() == 1);
+
+    // The const rank() only reads, so readers can share a bit_monoque, with or without build_rank().
+    rpnx::bit_monoque<> const &shared = b;
+    size_t before = shared.rank(ref.size() / 2);
+    b.build_rank();
+    assert(shared.rank(ref.size() / 2) == before && shared.count() == size_t(std::count(ref.begin(), ref.end(), true)));
+    std::vector<std::thread> readers;
+    std::vector<size_t> mismatches(4, 0);
+    for (size_t t = 0; t < 4; t++)
+      readers.emplace_back([&, t] {
+        for (size_t q = t; q <= ref.size(); q += 97)
+          mismatches[t] += shared.rank(q) != size_t(std::count(ref.begin(), ref.begin() + q, true));
+      });
+    for (auto &r : readers)
+      r.join();
+    assert(std::count(mismatches.begin(), mismatches.end(), size_t(0)) == 4);
+  }
+
+  {
+    // monoque_soa rows agree with a vector of tuples, and each column reads back as its own monoque.
+    size_t live = tester::dval;
+    {
+      rpnx::monoque_soa<uint32_t, std::string, double, tester> soa;
+      std::vector<std::tuple<uint32_t, std::string, double>> ref;
+      uint64_t x = 88172645463325252ull;
+      for (size_t i = 0; i < 3000; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        ref.emplace_back(uint32_t(x), std::to_string(x % 1000), double(i) * 0.5);
+        if (i % 2)
+          soa.push_back(std::make_tuple(uint32_t(x), std::to_string(x % 1000), double(i) * 0.5, tester()));
+        else
+          soa.emplace_back(uint32_t(x), std::to_string(x % 1000), double(i) * 0.5, tester());
+      }
+      assert(soa.size() == ref.size() && tester::dval == live + ref.size());
+      for (size_t i = 0; i < ref.size(); i++)
+        assert(std::get<0>(soa[i]) == std::get<0>(ref[i]) && std::get<1>(soa[i]) == std::get<1>(ref[i]) && soa.column<2>()[i] == std::get<2>(ref[i]));
+
+      std::get<1>(soa[7]) = "seven";
+      std::get<1>(ref[7]) = "seven";
+      for (auto row : soa)
+        std::get<0>(row) += 1;
+      for (auto &row : ref)
+        std::get<0>(row) += 1;
+
+      size_t i = 0;
+      for (auto it = soa.cbegin(); it != soa.cend(); ++it, ++i)
+        assert(std::get<0>(*it) == std::get<0>(ref[i]) && std::get<1>(*it) == std::get<1>(ref[i]));
+      assert(i == ref.size() && soa.end() - soa.begin() == ptrdiff_t(ref.size()));
+
+      auto prices = soa.column<2>();
+      double expect = 0;
+      for (auto &row : ref)
+        expect += std::get<2>(row);
+      assert(rpnx::simd::sum(prices) == expect);
+      size_t covered = 0;
+      for (size_t k = 0; k < prices.segment_count(); k++) {
+        assert(prices.segment(k).data() == &prices[covered]);
+        covered += prices.segment(k).size();
+      }
+      assert(covered == ref.size());
+
+      rpnx::monoque_soa<uint32_t, std::string, double, tester> copy = soa;
+      for (size_t n = 0; n < 1000; n++) {
+        soa.pop_back();
+        ref.pop_back();
+      }
+      assert(soa.size() == ref.size() && copy.size() == ref.size() + 1000);
+      assert(std::get<1>(soa.back()) == std::get<1>(ref.back()) && std::get<1>(copy[7]) == "seven");
+      copy.clear();
+      assert(copy.empty() && tester::dval == live + ref.size());
+      rpnx::monoque_soa<uint32_t, std::string, double, tester>::const_iterator from_mutable = soa.begin();
+      assert(from_mutable == soa.cbegin());
+    }
+    assert(tester::dval == live);
+
+    // With a pmr allocator every column, and every pmr::string field, allocates from the given resource.
+    std::pmr::monotonic_buffer_resource arena;
+    std::pmr::unsynchronized_pool_resource other_arena;
+    {
+      rpnx::pmr::monoque_soa<uint64_t, std::pmr::string> named{std::pmr::polymorphic_allocator<char>(&arena)};
+      for (uint64_t i = 0; i < 500; i++)
+        named.emplace_back(i, std::string(40, char('a' + i % 26)));
+      assert(std::get<1>(named[499]).get_allocator().resource() == &arena);
+
+      rpnx::pmr::monoque_soa<uint64_t, std::pmr::string> elsewhere{std::pmr::polymorphic_allocator<char>(&other_arena)};
+      elsewhere = named;
+      assert(elsewhere.get_allocator().resource() == &other_arena && std::get<1>(elsewhere[499]).get_allocator().resource() == &other_arena);
+      assert(std::get<0>(elsewhere[321]) == 321 && std::get<1>(elsewhere[321]) == std::get<1>(named[321]));
+      elsewhere = std::move(named);
+      assert(elsewhere.size() == 500 && std::get<1>(elsewhere[7]).get_allocator().resource() == &other_arena);
+
+      rpnx::pmr::monoque_soa<uint64_t, std::pmr::string> defaulted(elsewhere);
+      assert(defaulted.get_allocator().resource() == std::pmr::get_default_resource() && std::get<1>(defaulted[7]) == std::get<1>(elsewhere[7]));
+    }
+  }
+
+  {
+    // resize, resize_for_overwrite, truncate and pop_back(n) against std::vector, with leak checks.
+    size_t live = tester::dval;
+    {
+      rpnx::monoque<tester> t;
+      t.resize(1000);
+      assert(t.size() == 1000 && tester::dval == live + 1000);
+      t.resize(37);
+      assert(t.size() == 37 && tester::dval == live + 37);
+      t.resize_for_overwrite(300);
+      t.pop_back(200);
+      t.truncate(50);
+      assert(t.size() == 50 && tester::dval == live + 50);
+    }
+    assert(tester::dval == live);
+
+    rpnx::monoque<std::string> m;
+    std::vector<std::string> ref;
+    uint64_t x = 88172645463325252ull;
+    for (size_t step = 0; step < 200; step++) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      size_t n = x % 3000;
+      if (step % 4 == 0) {
+        m.resize(n, "fill");
+        ref.resize(n, "fill");
+      } else if (step % 4 == 1 && n <= ref.size()) {
+        m.pop_back(ref.size() - n);
+        ref.resize(n);
+      } else {
+        m.resize(n);
+        ref.resize(n);
+      }
+      if (!ref.empty()) {
+        m[n / 2] = std::to_string(step);
+        ref[n / 2] = std::to_string(step);
+      }
+      assert(m.size() == ref.size() && std::equal(ref.begin(), ref.end(), m.begin()));
+    }
+
+    rpnx::monoque<uint32_t> z;
+    z.resize(5000);
+    assert(std::count(z.begin(), z.end(), 0u) == 5000);
+    z.resize_for_overwrite(100000);
+    for (size_t i = 0; i < z.size(); i++)
+      z[i] = uint32_t(i);
+    z.truncate(70000);
+    z.resize(80000);
+    assert(z.size() == 80000 && z[69999] == 69999 && z[70000] == 0 && z[79999] == 0);
+
+    // Trivial elements still go through an allocator that has its own construct().
+    rpnx::monoque<uint32_t, marking_allocator<uint32_t>> marked;
+    marked.resize_for_overwrite(1000);
+    assert(std::count(marked.begin(), marked.end(), 0x5au) == 1000);
+  }
+
+  {
+    // Cached-pointer iterators across block boundaries, random jumps, and the segmented algorithms.
+    rpnx::monoque<uint64_t> m;
+    rpnx::monoque<uint64_t, std::allocator<uint64_t>, 16, true> inl;
+    std::vector<uint64_t> ref;
+    uint64_t x = 88172645463325252ull;
+    for (size_t i = 0; i < 5000; i++) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      m.push_back(x % 1000);
+      inl.push_back(x % 1000);
+      ref.push_back(x % 1000);
+    }
+    assert(std::equal(m.begin(), m.end(), ref.begin()) && std::equal(inl.cbegin(), inl.cend(), ref.begin()));
+    size_t i = ref.size();
+    for (auto it = m.end(); it != m.begin();)
+      assert(*--it == ref[--i]);
+
+    auto it = m.begin();
+    auto cit = inl.cbegin();
+    size_t pos = 0;
+    for (size_t step = 0; step < 20000; step++) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      size_t to = x % ref.size();
+      if (step % 3 == 0) {
+        it += ssize_t(to) - ssize_t(pos);
+        cit = cit - (ssize_t(pos) - ssize_t(to));
+        pos = to;
+      } else if (step % 3 == 1 && pos + 1 < ref.size()) {
+        ++it;
+        cit++;
+        pos++;
+      } else if (pos > 0) {
+        it--;
+        --cit;
+        pos--;
+      }
+      assert(*it == ref[pos] && *cit == ref[pos] && it.index() == pos);
+      assert(it[ssize_t(to) - ssize_t(pos)] == ref[to] && cit[ssize_t(to) - ssize_t(pos)] == ref[to]);
+    }
+    *it = 12345;
+    ref[pos] = 12345;
+
+    for (uint64_t v : {uint64_t(0), uint64_t(999), uint64_t(12345), uint64_t(5000)}) {
+      assert(rpnx::segmented::find(m.begin(), m.end(), v) - m.begin() == std::find(ref.begin(), ref.end(), v) - ref.begin());
+      assert(rpnx::segmented::find(m.cbegin() + 100, m.cend() - 7, v) - m.cbegin() == std::find(ref.begin() + 100, ref.end() - 7, v) - ref.begin());
+    }
+    auto big = [](uint64_t v) { return v > 997; };
+    assert(rpnx::segmented::find_if(inl.begin() + 3, inl.end(), big) - inl.begin() == std::find_if(ref.begin() + 3, ref.end(), big) - ref.begin());
+
+    std::vector<uint64_t> out;
+    rpnx::segmented::copy(m.cbegin() + 1, m.cend() - 1, std::back_inserter(out));
+    assert(std::equal(out.begin(), out.end(), ref.begin() + 1) && out.size() == ref.size() - 2);
+    rpnx::segmented::for_each(m.begin(), m.end(), [](uint64_t &v) { v *= 2; });
+    uint64_t total = 0;
+    rpnx::segmented::for_each(m.cbegin(), m.cend(), [&](uint64_t v) { total += v; });
+    assert(total == 2 * std::accumulate(ref.begin(), ref.end(), uint64_t(0)));
+    assert(*rpnx::segmented::find(out.begin(), out.end(), out[17]) == out[17]);
+    static_assert(rpnx::segmented::is_segmented_iterator<rpnx::monoque<int>::iterator>::value, "");
+    static_assert(!rpnx::segmented::is_segmented_iterator<std::vector<int>::iterator>::value, "");
+    static_assert(std::is_same<std::iterator_traits<rpnx::monoque<int>::const_iterator>::iterator_category, std::random_access_iterator_tag>::value, "");
+  }
+
+  {
+    // Every index backend decomposes indices the same way, checked against a block-by-block walk.
+    auto check = [](auto layout_tag, size_t limit) {
+      using L = decltype(layout_tag);
+      size_t k = 0, begin = 0;
+      for (size_t n = 0; n < limit; n++) {
+        if (n == begin + L::segment_capacity(k)) {
+          begin += L::segment_capacity(k);
+          k++;
+        }
+        assert(L::index1(n) == k && L::index2(n) == n - begin && L::sizeat(n) == L::segment_capacity(k));
+      }
+      for (size_t b = L::base_log2; b < 32; b++) {
+        size_t p = size_t(1) << b;
+        assert(L::index1(p) == b - L::base_log2 + 1 && L::index2(p) == 0 && L::index2(p - 1) == p / 2 - 1 + (b == L::base_log2) * p / 2);
+        assert((p < 8 || L::index2(p + 3) == 3) && L::sizeat(p) == p);
+      }
+    };
+    check(rpnx::basic_monoque_layout<2, rpnx::monoque_index_clz>(), 1 << 17);
+    check(rpnx::basic_monoque_layout<2, rpnx::monoque_index_bmi2>(), 1 << 17);
+    check(rpnx::basic_monoque_layout<2, rpnx::monoque_index_table>(), 1 << 17);
+    check(rpnx::basic_monoque_layout<2, rpnx::monoque_index_32>(), 1 << 17);
+    check(rpnx::basic_monoque_layout<16, rpnx::monoque_index_table>(), 1 << 17);
+    check(rpnx::basic_monoque_layout<16, rpnx::monoque_index_32>(), 1 << 17);
+
+    uint64_t x = 88172645463325252ull;
+    for (size_t i = 0; i < 100000; i++) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      size_t n = x >> (x % 64);
+      using C = rpnx::basic_monoque_layout<2, rpnx::monoque_index_clz>;
+      using B = rpnx::basic_monoque_layout<2, rpnx::monoque_index_bmi2>;
+      using T = rpnx::basic_monoque_layout<2, rpnx::monoque_index_table>;
+      assert(B::index1(n) == C::index1(n) && B::index2(n) == C::index2(n) && T::index1(n) == C::index1(n) && T::index2(n) == C::index2(n));
+      assert(C::sizeat(n) == C::segment_capacity(C::index1(n)) && C::index2(n) < C::sizeat(n));
+      if (n <= UINT32_MAX) {
+        using S = rpnx::basic_monoque_layout<2, rpnx::monoque_index_32>;
+        assert(S::index1(n) == C::index1(n) && S::index2(n) == C::index2(n));
+      }
+    }
+
+    rpnx::monoque<uint32_t, std::allocator<uint32_t>, 2, false, rpnx::no_monoque_stats, rpnx::monoque_index_table> m;
+    for (uint32_t i = 0; i < 10000; i++)
+      m.push_back(i);
+    for (size_t i = 0; i < m.size(); i += 37) {
+      auto run = m.run_at(i);
+      assert(run.size() != 0 && i + run.size() <= m.size());
+      for (size_t j = 0; j < run.size(); j++)
+        assert(run[j] == i + j && &run[j] == &m[i + j]);
+      assert(i + run.size() == m.size() || &m[i + run.size()] != run.end());
+    }
+    assert(static_cast<rpnx::monoque<uint32_t> const &>(rpnx::monoque<uint32_t>(m.begin(), m.end())).run_at(9999).size() == 1);
+  }
+
+  {
+    // pmr::monoque allocates every block, and its elements' storage, from the given resource, and keeps it across assignment.
+    struct counting_resource : std::pmr::memory_resource {
+      std::pmr::memory_resource *up = std::pmr::new_delete_resource();
+      size_t live = 0, calls = 0;
+      void *do_allocate(size_t bytes, size_t align) override {
+        live += bytes;
+        calls++;
+        return up->allocate(bytes, align);
+      }
+      void do_deallocate(void *p, size_t bytes, size_t align) override {
+        live -= bytes;
+        up->deallocate(p, bytes, align);
+      }
+      bool do_is_equal(std::pmr::memory_resource const &o) const noexcept override { return this == &o; }
+    };
+    counting_resource a, b;
+    {
+      rpnx::pmr::monoque<std::pmr::string> m(&a);
+      for (size_t i = 0; i < 1000; i++)
+        m.emplace_back(std::string(40, char('a' + i % 26)));
+      assert(a.live != 0 && m[999].get_allocator().resource() == &a);
+      size_t before = a.calls;
+
+      rpnx::pmr::monoque<std::pmr::string> other(&b);
+      other = m;
+      assert(other.get_allocator().resource() == &b && other[5] == m[5] && a.calls == before && b.live != 0);
+
+      rpnx::pmr::monoque<std::pmr::string> moved(&b);
+      moved = std::move(m);
+      assert(moved.get_allocator().resource() == &b && moved.size() == 1000 && moved[999][0] == char('a' + 999 % 26));
+
+      rpnx::pmr::monoque<std::pmr::string> stolen(std::move(moved));
+      assert(stolen.get_allocator().resource() == &b && stolen.size() == 1000 && moved.size() == 0);
+      stolen.swap(other);
+      assert(stolen.size() == 1000 && other.size() == 1000);
+
+      rpnx::pmr::monoque<std::pmr::string> defaulted(stolen);
+      assert(defaulted.get_allocator().resource() == std::pmr::get_default_resource());
+
+      // resize_for_overwrite constructs through the allocator, so the new strings use the container's resource.
+      rpnx::pmr::monoque<std::pmr::string> blank(&a);
+      blank.resize_for_overwrite(100);
+      assert(blank.size() == 100 && blank[0].empty() && blank[99].get_allocator().resource() == &a);
+      blank[99].assign(100, 'x');
+    }
+    assert(a.live == 0 && b.live == 0);
+
+    // A monotonic arena: nothing reaches the upstream allocator until the arena itself runs out.
+    std::vector<char> arena(size_t(1) << 20);
+    std::pmr::monotonic_buffer_resource pool(arena.data(), arena.size(), std::pmr::null_memory_resource());
+    rpnx::pmr::monoque<uint64_t> ids(&pool);
+    for (uint64_t i = 0; i < 10000; i++)
+      ids.push_back(i);
+    assert(ids.size() == 10000 && ids[9999] == 9999);
+  }
+
+  {
+    // compact_monoque: the superblock layout, against std::vector, with O(sqrt n) slack and leak checks.
+    size_t i = 0, d = 0;
+    for (size_t sb = 0; i < (size_t(1) << 18); sb++)
+      for (size_t b = 0; b < (size_t(1) << (sb / 2)); b++, d++)
+        for (size_t o = 0; o < (size_t(1) << ((sb + 1) / 2)); o++, i++) {
+          size_t d2, o2;
+          std::tie(d2, o2) = rpnx::compact_monoque_layout::index(i);
+          assert(d2 == d && o2 == o && rpnx::compact_monoque_layout::sizeat(i) == size_t(1) << ((sb + 1) / 2));
+        }
+
+    size_t live = tester::dval;
+    {
+      rpnx::compact_monoque<tester> t;
+      for (size_t n = 0; n < 1000; n++)
+        t.emplace_back();
+      for (size_t n = 0; n < 300; n++)
+        t.pop_back();
+      assert(tester::dval == live + 700);
+      rpnx::compact_monoque<tester> copy = t;
+      assert(tester::dval == live + 1400);
+    }
+    assert(tester::dval == live);
+
+    rpnx::compact_monoque<std::string> m;
+    std::vector<std::string> ref;
+    uint64_t x = 88172645463325252ull;
+    for (size_t step = 0; step < 300000; step++) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      if (x % 5 < 3 || ref.empty()) {
+        m.push_back(std::to_string(step));
+        ref.push_back(std::to_string(step));
+      } else {
+        m.pop_back();
+        ref.pop_back();
+      }
+      if (step % 997 == 0) {
+        assert(m.size() == ref.size() && std::equal(ref.begin(), ref.end(), m.begin()));
+        // One partly filled block plus at most one spare, each about sqrt(size) long.
+        assert(m.capacity() - m.size() <= 4 * rpnx::compact_monoque_layout::sizeat(m.size()));
+      }
+    }
+    assert(m.back() == ref.back() && m.at(ref.size() / 2) == ref[ref.size() / 2]);
+    size_t covered = 0;
+    m.for_each_segment(100, ref.size(), [&](std::string const *p, size_t n) {
+      for (size_t j = 0; j < n; j++)
+        assert(p[j] == ref[100 + covered + j]);
+      covered += n;
+    });
+    assert(covered == ref.size() - 100);
+    while (m.size() > 10)
+      m.pop_back();
+    m.shrink_to_fit();
+    assert(m.capacity() - m.size() < 4 && m.block_count() <= 5);
+  }
+
   std::priority_queue<int, rpnx::monoque<int>> test_queue;
 
   test_queue.push(4);